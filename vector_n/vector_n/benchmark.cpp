@@ -0,0 +1,517 @@
+// Benchmarks of vector_n against raw pointers and nested std::vector.
+// Every benchmark is run a few times untimed, then the given number of times; the median
+// time is reported as ns per element and GB/s, min and the relative deviation show the noise.
+// Usage: vector_n_benchmark [--reps N] [--warmup N] [--filter text] [--csv]
+
+#include <iostream>
+#include "vector_n.h"
+#include "vector_n_tiled.h"
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+typedef std::vector<int> vec_int;
+typedef std::vector<vec_int> vec2_int;
+typedef std::vector<vec2_int> vec3_int;
+typedef std::vector<vec3_int> vec4_int;
+
+// Results are added here, so the compiler can't throw the loops away
+static volatile long long sink = 0;
+
+struct Options
+{
+	int reps = 10;
+	int warmup = 2;
+	std::string filter;
+	bool csv = false;
+};
+
+class Runner
+{
+public:
+	explicit Runner(const Options &options) : options(options)
+	{
+		if (options.csv) std::printf("name,elements,bytes,min_s,median_s,mean_s,stddev_s,ns_per_element,gb_per_s\n");
+		else std::printf("%-40s %10s %10s %12s %8s\n", "benchmark", "ns/elem", "GB/s", "min ns/elem", "stddev");
+	}
+
+	// f() runs the benchmark once, elements and bytes are what one run touches
+	template<class Function>
+	void run(const std::string &name, double elements, double bytes, Function f)
+	{
+		if (!options.filter.empty() && name.find(options.filter) == std::string::npos) return;
+
+		for (int i = 0; i < options.warmup; ++i) f();
+
+		std::vector<double> seconds;
+		for (int i = 0; i < options.reps; ++i)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			f();
+			seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		}
+		report(name, elements, bytes, seconds);
+	}
+
+private:
+	Options options;
+
+	void report(const std::string &name, double elements, double bytes, std::vector<double> seconds) const
+	{
+		std::sort(seconds.begin(), seconds.end());
+		const size_t n = seconds.size();
+		const double median = n % 2 == 1 ? seconds[n / 2] : (seconds[n / 2 - 1] + seconds[n / 2]) / 2;
+		double mean = 0, deviation = 0;
+		for (double s : seconds) mean += s / n;
+		for (double s : seconds) deviation += (s - mean) * (s - mean) / n;
+		deviation = std::sqrt(deviation);
+
+		if (options.csv)
+		{
+			std::printf("%s,%.0f,%.0f,%.9f,%.9f,%.9f,%.9f,%.4f,%.4f\n", name.c_str(), elements, bytes,
+				seconds.front(), median, mean, deviation, median * 1e9 / elements, bytes / median / 1e9);
+		}
+		else
+		{
+			std::printf("%-40s %10.3f %10.2f %12.3f %7.1f%%\n", name.c_str(), median * 1e9 / elements,
+				bytes / median / 1e9, seconds.front() * 1e9 / elements, 100 * deviation / mean);
+		}
+		std::fflush(stdout);
+	}
+};
+
+void benchAccess2d(Runner &runner)
+{
+	const int n1 = 4096, n2 = 2048;
+	const double count = double(n1) * n2, bytes = count * sizeof(int);
+
+	vector_n<int, 2> a(n1, n2);
+	std::vector<int> raw(size_t(n1) * n2);
+	vec2_int nested(n1, vec_int(n2));
+
+	runner.run("write 2d / vector_n", count, bytes, [&]
+	{
+		for (int i = 0; i < n1; ++i)
+			for (int j = 0; j < n2; ++j) a(i, j) = i + j;
+	});
+	runner.run("write 2d / raw", count, bytes, [&]
+	{
+		int *p = raw.data();
+		for (int i = 0; i < n1; ++i)
+			for (int j = 0; j < n2; ++j) p[size_t(i) * n2 + j] = i + j;
+	});
+	runner.run("write 2d / nested", count, bytes, [&]
+	{
+		for (int i = 0; i < n1; ++i)
+			for (int j = 0; j < n2; ++j) nested[i][j] = i + j;
+	});
+}
+
+void benchAccess3d(Runner &runner)
+{
+	const int n1 = 256, n2 = 256, n3 = 128;
+	const double count = double(n1) * n2 * n3, bytes = count * sizeof(int);
+
+	vector_n<int, 3> a(n1, n2, n3);
+	std::vector<int> raw(size_t(n1) * n2 * n3);
+	vec3_int nested(n1, vec2_int(n2, vec_int(n3)));
+
+	runner.run("write 3d / vector_n", count, bytes, [&]
+	{
+		for (int i = 0; i < n1; ++i)
+			for (int j = 0; j < n2; ++j)
+				for (int k = 0; k < n3; ++k) a(i, j, k) = i + j + k;
+	});
+	runner.run("write 3d / raw", count, bytes, [&]
+	{
+		int *p = raw.data();
+		for (int i = 0; i < n1; ++i)
+			for (int j = 0; j < n2; ++j)
+				for (int k = 0; k < n3; ++k) p[(size_t(i) * n2 + j) * n3 + k] = i + j + k;
+	});
+	runner.run("write 3d / nested", count, bytes, [&]
+	{
+		for (int i = 0; i < n1; ++i)
+			for (int j = 0; j < n2; ++j)
+				for (int k = 0; k < n3; ++k) nested[i][j][k] = i + j + k;
+	});
+
+	runner.run("read 3d / vector_n", count, bytes, [&]
+	{
+		long long sum = 0;
+		for (int i = 0; i < n1; ++i)
+			for (int j = 0; j < n2; ++j)
+				for (int k = 0; k < n3; ++k) sum += a(i, j, k);
+		sink += sum;
+	});
+	runner.run("read 3d / raw", count, bytes, [&]
+	{
+		const int *p = raw.data();
+		long long sum = 0;
+		for (int i = 0; i < n1; ++i)
+			for (int j = 0; j < n2; ++j)
+				for (int k = 0; k < n3; ++k) sum += p[(size_t(i) * n2 + j) * n3 + k];
+		sink += sum;
+	});
+	runner.run("read 3d / nested", count, bytes, [&]
+	{
+		long long sum = 0;
+		for (int i = 0; i < n1; ++i)
+			for (int j = 0; j < n2; ++j)
+				for (int k = 0; k < n3; ++k) sum += nested[i][j][k];
+		sink += sum;
+	});
+
+	// Fixing the outer dimension gives contiguous planes, fixing the inner one gives strided ones
+	runner.run("fix<0> 3d / vector_n", count, bytes, [&]
+	{
+		long long sum = 0;
+		for (int i = 0; i < n1; ++i)
+		{
+			const auto s = a.fix<0>(i);
+			for (int j = 0; j < n2; ++j)
+				for (int k = 0; k < n3; ++k) sum += s(j, k);
+		}
+		sink += sum;
+	});
+	runner.run("fix<0> 3d / raw", count, bytes, [&]
+	{
+		long long sum = 0;
+		for (int i = 0; i < n1; ++i)
+		{
+			const int *s = raw.data() + size_t(i) * n2 * n3;
+			for (int j = 0; j < n2; ++j)
+				for (int k = 0; k < n3; ++k) sum += s[size_t(j) * n3 + k];
+		}
+		sink += sum;
+	});
+	runner.run("fix<2> 3d / vector_n", count, bytes, [&]
+	{
+		long long sum = 0;
+		for (int k = 0; k < n3; ++k)
+		{
+			const auto s = a.fix<2>(k);
+			for (int i = 0; i < n1; ++i)
+				for (int j = 0; j < n2; ++j) sum += s(i, j);
+		}
+		sink += sum;
+	});
+	runner.run("fix<2> 3d / raw", count, bytes, [&]
+	{
+		long long sum = 0;
+		for (int k = 0; k < n3; ++k)
+		{
+			const int *s = raw.data() + k;
+			for (int i = 0; i < n1; ++i)
+				for (int j = 0; j < n2; ++j) sum += s[(size_t(i) * n2 + j) * n3];
+		}
+		sink += sum;
+	});
+	runner.run("fix<2> 3d / nested", count, bytes, [&]
+	{
+		long long sum = 0;
+		for (int k = 0; k < n3; ++k)
+			for (int i = 0; i < n1; ++i)
+				for (int j = 0; j < n2; ++j) sum += nested[i][j][k];
+		sink += sum;
+	});
+}
+
+void benchAccess4d(Runner &runner)
+{
+	const int n1 = 64, n2 = 64, n3 = 64, n4 = 32;
+	const double count = double(n1) * n2 * n3 * n4, bytes = count * sizeof(int);
+
+	vector_n<int, 4> a(n1, n2, n3, n4);
+	std::vector<int> raw(static_cast<size_t>(count));
+	vec4_int nested(n1, vec3_int(n2, vec2_int(n3, vec_int(n4))));
+
+	runner.run("write 4d / vector_n", count, bytes, [&]
+	{
+		for (int i = 0; i < n1; ++i)
+			for (int j = 0; j < n2; ++j)
+				for (int k = 0; k < n3; ++k)
+					for (int g = 0; g < n4; ++g) a(i, j, k, g) = i + j + k + g;
+	});
+	runner.run("write 4d / raw", count, bytes, [&]
+	{
+		int *p = raw.data();
+		for (int i = 0; i < n1; ++i)
+			for (int j = 0; j < n2; ++j)
+				for (int k = 0; k < n3; ++k)
+					for (int g = 0; g < n4; ++g) p[((size_t(i) * n2 + j) * n3 + k) * n4 + g] = i + j + k + g;
+	});
+	runner.run("write 4d / nested", count, bytes, [&]
+	{
+		for (int i = 0; i < n1; ++i)
+			for (int j = 0; j < n2; ++j)
+				for (int k = 0; k < n3; ++k)
+					for (int g = 0; g < n4; ++g) nested[i][j][k][g] = i + j + k + g;
+	});
+}
+
+// Traversal in the order of get_indexer<I0, I1, I2>() (I2 is the innermost), with the indexer,
+// for_each and the raw loops in the same order
+template<int I0, int I1, int I2>
+void benchTraversal(Runner &runner, const vector_n<int, 3> &a, const std::vector<int> &raw)
+{
+	const std::string order = std::to_string(I0) + std::to_string(I1) + std::to_string(I2);
+	const vector_size<3> &sizes = a.size();
+	const double count = double(sizes[0]) * sizes[1] * sizes[2], bytes = count * sizeof(int);
+
+	runner.run("indexer<" + order + "> / vector_n", count, bytes, [&]
+	{
+		long long sum = 0;
+		for (auto x : a.get_indexer<I0, I1, I2>()) sum += x.value;
+		sink += sum;
+	});
+	runner.run("for_each<" + order + "> / vector_n", count, bytes, [&]
+	{
+		long long sum = 0;
+		for_each<I0, I1, I2>(a, [&](int x) { sum += x; });
+		sink += sum;
+	});
+	runner.run("indexer<" + order + "> / raw", count, bytes, [&]
+	{
+		const size_t strides[3] = {sizes[1] * sizes[2], sizes[2], 1};
+		const int *p = raw.data();
+		long long sum = 0;
+		for (size_t i = 0; i < sizes[I0]; ++i)
+			for (size_t j = 0; j < sizes[I1]; ++j)
+				for (size_t k = 0; k < sizes[I2]; ++k) sum += p[i * strides[I0] + j * strides[I1] + k * strides[I2]];
+		sink += sum;
+	});
+}
+
+void benchTraversals(Runner &runner)
+{
+	const int n1 = 192, n2 = 160, n3 = 128;
+	vector_n<int, 3> a(n1, n2, n3);
+	for_each(a, [n = 0](int &x) mutable { x = n++ % 1000; });
+	std::vector<int> raw(a.elements().begin(), a.elements().end());
+
+	benchTraversal<0, 1, 2>(runner, a, raw);
+	benchTraversal<0, 2, 1>(runner, a, raw);
+	benchTraversal<1, 0, 2>(runner, a, raw);
+	benchTraversal<1, 2, 0>(runner, a, raw);
+	benchTraversal<2, 0, 1>(runner, a, raw);
+	benchTraversal<2, 1, 0>(runner, a, raw);
+}
+
+void benchCopyResize(Runner &runner)
+{
+	const int n1 = 256, n2 = 256, n3 = 128;
+	const size_t count = size_t(n1) * n2 * n3;
+
+	vector_n<int, 3> a(n1, n2, n3), b(n1, n2, n3);
+	for_each(a, [n = 0](int &x) mutable { x = n++; });
+	std::vector<int> raw(count, 1), rawCopy(count);
+	vec3_int nested(n1, vec2_int(n2, vec_int(n3, 1))), nestedCopy(n1, vec2_int(n2, vec_int(n3)));
+
+	// The destination has the same sizes, so only the elements are copied
+	runner.run("copy 3d / vector_n", double(count), 2.0 * count * sizeof(int), [&]
+	{
+		b = a;
+		sink += b(n1 - 1, n2 - 1, n3 - 1);
+	});
+	runner.run("copy_from 3d / vector_n", double(count), 2.0 * count * sizeof(int), [&]
+	{
+		b.copy_from(a);
+		sink += b(n1 - 1, n2 - 1, n3 - 1);
+	});
+	runner.run("copy 3d / operator()", double(count), 2.0 * count * sizeof(int), [&]
+	{
+		for (int i = 0; i < n1; ++i)
+			for (int j = 0; j < n2; ++j)
+				for (int k = 0; k < n3; ++k) b(i, j, k) = a(i, j, k);
+		sink += b(n1 - 1, n2 - 1, n3 - 1);
+	});
+	// Every plane of the strided slice has contiguous rows only
+	runner.run("copy_from strided 3d / vector_n", double(count) / 2, double(count) * sizeof(int), [&]
+	{
+		b.slice({{}, {0, size_t(n2), 2}, {}}).copy_from(a.slice({{}, {1, size_t(n2), 2}, {}}));
+		sink += b(n1 - 1, n2 - 2, n3 - 1);
+	});
+	runner.run("fill 3d / vector_n", double(count), double(count) * sizeof(int), [&]
+	{
+		b.fill(7);
+		sink += b(n1 - 1, n2 - 1, n3 - 1);
+	});
+	runner.run("fill 3d / raw", double(count), double(count) * sizeof(int), [&]
+	{
+		std::fill(rawCopy.begin(), rawCopy.end(), 7);
+		sink += rawCopy.back();
+	});
+	runner.run("copy 3d / raw", double(count), 2.0 * count * sizeof(int), [&]
+	{
+		std::memcpy(rawCopy.data(), raw.data(), count * sizeof(int));
+		sink += rawCopy.back();
+	});
+	runner.run("copy 3d / nested", double(count), 2.0 * count * sizeof(int), [&]
+	{
+		nestedCopy = nested;
+		sink += nestedCopy[n1 - 1][n2 - 1][n3 - 1];
+	});
+
+	// Allocation and zero initialisation from the empty array
+	runner.run("resize 3d / vector_n", double(count), double(count) * sizeof(int), [&]
+	{
+		vector_n<int, 3> c;
+		c.resize(n1, n2, n3);
+		sink += c(n1 - 1, n2 - 1, n3 - 1);
+	});
+	runner.run("resize 3d / raw", double(count), double(count) * sizeof(int), [&]
+	{
+		std::unique_ptr<int[]> c(new int[count]());
+		sink += c[count - 1];
+	});
+	runner.run("resize 3d / nested", double(count), double(count) * sizeof(int), [&]
+	{
+		vec3_int c;
+		c.resize(n1, vec2_int(n2, vec_int(n3)));
+		sink += c[n1 - 1][n2 - 1][n3 - 1];
+	});
+}
+
+// Sum of the 3x3x3 neighbourhood of every interior point: sweeps and random queries
+template<class Array>
+float neighbourhoodSum(const Array &a, int x, int y, int z)
+{
+	float sum = 0;
+	for (int dx = -1; dx <= 1; ++dx)
+		for (int dy = -1; dy <= 1; ++dy)
+			for (int dz = -1; dz <= 1; ++dz) sum += a(x + dx, y + dy, z + dz);
+	return sum;
+}
+
+void benchNeighbours3d(Runner &runner)
+{
+	const int n = 128, queries = 1000000;
+	const double count = double(n - 2) * (n - 2) * (n - 2);
+
+	vector_n<float, 3> linear(n, n, n);
+	vector_n_tiled<float, 3> tiled(n, n, n);
+	for (int i1 = 0; i1 < n; ++i1)
+		for (int i2 = 0; i2 < n; ++i2)
+			for (int i3 = 0; i3 < n; ++i3) linear(i1, i2, i3) = tiled(i1, i2, i3) = float((i1 + i2 + i3) % 7);
+
+	std::vector<int> points(3 * queries);
+	std::srand(1);
+	for (int &p : points) p = 1 + std::rand() % (n - 2);
+
+	runner.run("neighbours sweep / vector_n", count, 27 * count * sizeof(float), [&]
+	{
+		double sum = 0;
+		for (int i1 = 1; i1 < n - 1; ++i1)
+			for (int i2 = 1; i2 < n - 1; ++i2)
+				for (int i3 = 1; i3 < n - 1; ++i3) sum += neighbourhoodSum(linear, i1, i2, i3);
+		sink += (long long)sum;
+	});
+	// Brick by brick, so the neighbourhoods stay in cache
+	runner.run("neighbours sweep / vector_n_tiled", count, 27 * count * sizeof(float), [&]
+	{
+		double sum = 0;
+		tiled.for_each_brick([&](const vector_size<3> &from, const vector_size<3> &to)
+		{
+			for (int i1 = std::max<int>(int(from[0]), 1); i1 < std::min<int>(int(to[0]), n - 1); ++i1)
+				for (int i2 = std::max<int>(int(from[1]), 1); i2 < std::min<int>(int(to[1]), n - 1); ++i2)
+					for (int i3 = std::max<int>(int(from[2]), 1); i3 < std::min<int>(int(to[2]), n - 1); ++i3)
+						sum += neighbourhoodSum(tiled, i1, i2, i3);
+		});
+		sink += (long long)sum;
+	});
+	runner.run("neighbours random / vector_n", queries, 27.0 * queries * sizeof(float), [&]
+	{
+		double sum = 0;
+		for (int q = 0; q < queries; ++q) sum += neighbourhoodSum(linear, points[3 * q], points[3 * q + 1], points[3 * q + 2]);
+		sink += (long long)sum;
+	});
+	runner.run("neighbours random / vector_n_tiled", queries, 27.0 * queries * sizeof(float), [&]
+	{
+		double sum = 0;
+		for (int q = 0; q < queries; ++q) sum += neighbourhoodSum(tiled, points[3 * q], points[3 * q + 1], points[3 * q + 2]);
+		sink += (long long)sum;
+	});
+}
+
+void benchReduceAxes(Runner &runner)
+{
+	const int nt = 64, n1 = 64, n2 = 64, n3 = 64;
+	const size_t count = size_t(nt) * n1 * n2 * n3;
+
+	vector_n<float, 4> a(nt, n1, n2, n3);
+	for_each(a, [n = 0](float &x) mutable { x = float(n++ % 11); });
+	std::vector<float> raw(a.begin(), a.end()), rawSum(count / nt);
+
+	// Collapse of the outermost (time) axis, the rows stay contiguous
+	runner.run("reduce<0> 4d / vector_n", double(count), double(count) * sizeof(float), [&]
+	{
+		const vector_n<float, 3> res = a.reduce<0>(std::plus<>(), 1);
+		sink += (long long)res(1, 2, 3);
+	});
+	runner.run("reduce<0> 4d / vector_n parallel", double(count), double(count) * sizeof(float), [&]
+	{
+		const vector_n<float, 3> res = a.reduce<0>(std::plus<>());
+		sink += (long long)res(1, 2, 3);
+	});
+	runner.run("reduce<0> 4d / raw", double(count), double(count) * sizeof(float), [&]
+	{
+		const size_t inner = count / nt;
+		std::copy(raw.begin(), raw.begin() + inner, rawSum.begin());
+		for (int t = 1; t < nt; ++t)
+			for (size_t i = 0; i < inner; ++i) rawSum[i] += raw[t * inner + i];
+		sink += (long long)rawSum[1];
+	});
+	runner.run("reduce<3> 4d / vector_n", double(count), double(count) * sizeof(float), [&]
+	{
+		const vector_n<float, 3> res = a.reduce<3>(std::plus<>(), 1);
+		sink += (long long)res(1, 2, 3);
+	});
+	runner.run("reduce<0> 4d / nested loops", double(count), double(count) * sizeof(float), [&]
+	{
+		vector_n<float, 3> res(n1, n2, n3);
+		for (int i1 = 0; i1 < n1; ++i1)
+			for (int i2 = 0; i2 < n2; ++i2)
+				for (int i3 = 0; i3 < n3; ++i3)
+				{
+					float s = 0;
+					for (int t = 0; t < nt; ++t) s += a(t, i1, i2, i3);
+					res(i1, i2, i3) = s;
+				}
+		sink += (long long)res(1, 2, 3);
+	});
+}
+
+int main(int argc, char **argv)
+{
+	Options options;
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg = argv[i];
+		if (arg == "--csv") options.csv = true;
+		else if (arg == "--reps" && i + 1 < argc) options.reps = std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--warmup" && i + 1 < argc) options.warmup = std::max(0, std::atoi(argv[++i]));
+		else if (arg == "--filter" && i + 1 < argc) options.filter = argv[++i];
+		else
+		{
+			std::cerr << "Usage: " << argv[0] << " [--reps N] [--warmup N] [--filter text] [--csv]\n";
+			return 1;
+		}
+	}
+
+	Runner runner(options);
+	benchAccess2d(runner);
+	benchAccess3d(runner);
+	benchAccess4d(runner);
+	benchTraversals(runner);
+	benchCopyResize(runner);
+	benchNeighbours3d(runner);
+	benchReduceAxes(runner);
+	return 0;
+}
@@ -3,148 +3,72 @@
 
 #include <iostream>
 #include "vector_n.h"
-#include <omp.h>
-#include <ctime>
+#include "vector_n_fixed.h"
+#include "vector_n_mmap.h"
+#include "vector_n_io.h"
+#include "vector_n_tiled.h"
+#include "vector_n_stencil.h"
+#include "vector_n_sparse.h"
+#include "vector_n_chunked.h"
+#include "vector_n_cow.h"
+#include <sstream>
+#include <string>
+#include <cstdio>
 #include <cassert>
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+#include <atomic>
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
 
+// Counts every allocation, so the tests can check that nothing was allocated. All forms are
+// replaced, so every new is paired with its delete; the counter is atomic, as the worker
+// threads of the parallel tests allocate too
+static std::atomic<size_t> allocationCount{0};
 
-typedef std::vector<int> vec_int;
-typedef std::vector<vec_int> vec2_int;
-typedef std::vector<vec2_int> vec3_int;
-
-void testVector4d()
+static void *countedAlloc(size_t size)
 {
-	int nx = 200, ny = 60, nz = 70, nt = 200;
-
-	vector_n<int, 4> a(nx, ny, nz, nt);
-	std::vector<std::vector<std::vector<vec_int>>> vec4;
-	vec4.resize(nx, vec3_int(ny, vec2_int(nz, vec_int(nt))));
-	std::vector<int> expected_data;
-
-	size_t start_time_new = clock(); // начальное время
-
-//#pragma omp parallel for
-	for (int i = 0, n = 0; i < nx; ++i)
-	{
-		for (int j = 0; j < ny; ++j)
-		{
-			for (int k = 0; k < nz; ++k)
-			{
-				for (int g = 0; g < nt; ++g)
-				{
-					//expected_data.push_back(n);
-					a(i, j, k, g) = i + j + k + g;// n;
-					//++n;
-				}
-			}
-		}
-	}
-
-	size_t search_time = clock() - start_time_new; // искомое в
-
-	std::cout << "TIME 1-DIM VECTOR = " << search_time << std::endl;
-
-	size_t start_time_vec = clock(); // начальное время
-//#pragma omp parallel for
-	for (int i = 0, n = 0; i < nx; ++i)
-	{
-		for (int j = 0; j < ny; ++j)
-		{
-			for (int k = 0; k < nz; ++k)
-			{
-				for (int g = 0; g < nt; ++g)
-				{
-					vec4[i][j][k][g] = i + j + k + g;// ++n;
-				}
-			}
-		}
-	}
-
-	size_t time_vec = clock() - start_time_vec; // искомое в
-	std::cout << "TIME 4-DIM VECTOR = " << time_vec << std::endl;
-	std::cout << "TOTAL AMOUNT = " << nx * ny * nz * nt << std::endl;
-	std::cout << std::endl;
+	++allocationCount;
+	if (void *ptr = std::malloc(size != 0 ? size : 1)) return ptr;
+	throw std::bad_alloc();
 }
 
-void testVector2d()
+static void *countedAlloc(size_t size, std::align_val_t alignment)
 {
-	int nx = 40000, ny = 4200;
-
-	vector_n<int, 2> a(nx, ny);
-	std::vector<vec_int> vec4;
-	vec4.resize(nx, vec_int(ny));
-
-	size_t start_time_new = clock(); // начальное время
-	for (int i = 0, n = 0; i < nx; ++i)
-	{
-		for (int j = 0; j < ny; ++j)
-		{
-			a(i, j) = n;
-			++n;
-		}
-	}
-
-	size_t search_time = clock() - start_time_new; // искомое в
-
-	std::cout << "TIME 1-DIM VECTOR = " << search_time << std::endl;
-
-	size_t start_time_vec = clock(); // начальное время
-	for (int i = 0, n = 0; i < nx; ++i)
-	{
-		for (int j = 0; j < ny; ++j)
-		{
-			vec4[i][j] = ++n;
-		}
-	}
-
-	size_t time_vec = clock() - start_time_vec; // искомое в
-	std::cout << "TIME 2-DIM VECTOR = " << time_vec << std::endl;
-	std::cout << "TOTAL AMOUNT = " << nx * ny << std::endl;
-	std::cout << std::endl;
-
+	++allocationCount;
+	const size_t align = std::max(size_t(alignment), sizeof(void*));
+#ifdef _MSC_VER
+	if (void *ptr = _aligned_malloc(std::max<size_t>(size, 1), align)) return ptr;
+#else
+	if (void *ptr = std::aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) / align * align)) return ptr;
+#endif
+	throw std::bad_alloc();
 }
 
-void testVector3d()
+static void alignedFree(void *ptr)
 {
-	int nx = 1000, ny = 1000, nz = 160;
-
-	vector_n<int, 3> a(nx, ny, nz);
-	std::vector<std::vector<vec_int>> vec3;
-	vec3.resize(nx, vec2_int(ny, vec_int(nz)));
-
-	size_t start_time_new = clock(); // начальное время
-	for (int i = 0, n = 0; i < nx; ++i)
-	{
-		for (int j = 0; j < ny; ++j)
-		{
-			for (int k = 0; k < nz; ++k)
-			{
-				a(i, j, k) = n;
-				++n;
-			}
-		}
-	}
-
-	size_t search_time = clock() - start_time_new;
-	std::cout << "TIME 1-DIM VECTOR = " << search_time << std::endl;
+#ifdef _MSC_VER
+	_aligned_free(ptr);
+#else
+	std::free(ptr);
+#endif
+}
 
-	size_t start_time_vec = clock(); // начальное время
-	for (int i = 0, n = 0; i < nx; ++i)
-	{
-		for (int j = 0; j < ny; ++j)
-		{
-			for (int k = 0; k < nz; ++k)
-			{
-				vec3[i][j][k] = ++n;
-			}
-		}
-	}
+void *operator new(size_t size) { return countedAlloc(size); }
+void *operator new[](size_t size) { return countedAlloc(size); }
+void *operator new(size_t size, std::align_val_t alignment) { return countedAlloc(size, alignment); }
+void *operator new[](size_t size, std::align_val_t alignment) { return countedAlloc(size, alignment); }
 
-	size_t time_vec = clock() - start_time_vec;
-	std::cout << "TIME 3-DIM VECTOR = " << time_vec << std::endl;
-	std::cout << "TOTAL AMOUNT = " << nx * ny * nz << std::endl;
-	std::cout << std::endl;
-}
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::align_val_t) noexcept { alignedFree(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept { alignedFree(ptr); }
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept { alignedFree(ptr); }
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept { alignedFree(ptr); }
 
 bool test_index_full_1()
 {
@@ -365,12 +289,1330 @@ bool test_copy_assignment()
 	return a(0, 0, 0) == 21;
 }
 
+bool test_move_constructor()
+{
+	vector_n<int, 3> a(3, 4, 5);
+	a(1, 2, 3) = 42;
+	const int *buf = &a(0, 0, 0);
+
+	size_t allocations = allocationCount;
+	vector_n<int, 3> b = std::move(a);
+	if (allocationCount != allocations) return false;
+
+	if (&b(0, 0, 0) != buf || b(1, 2, 3) != 42) return false;
+	if (b.size() != vector_size<3>{3, 4, 5}) return false;
+
+	// Moved-from object must be empty
+	return a.size() == vector_size<3>{0, 0, 0} && a.begin() == a.end();
+}
+
+bool test_move_assignment()
+{
+	vector_n<int, 2> a(3, 4);
+	vector_n<int, 2> b(5, 6);
+	a(2, 3) = 7;
+	const int *buf = &a(0, 0);
+
+	size_t allocations = allocationCount;
+	b = std::move(a);
+	if (allocationCount != allocations) return false;
+
+	return &b(0, 0) == buf && b(2, 3) == 7 && b.size() == vector_size<2>{3, 4};
+}
+
+bool test_swap()
+{
+	vector_n<int, 2> a(3, 4);
+	vector_n<int, 2> b(5, 6);
+	a(2, 3) = 1;
+	b(4, 5) = 2;
+	const int *bufA = &a(0, 0);
+	const int *bufB = &b(0, 0);
+
+	size_t allocations = allocationCount;
+	std::swap(a, b);
+	swap(a, b);
+	std::swap(a, b);
+	if (allocationCount != allocations) return false;
+	if (&a(0, 0) != bufB || &b(0, 0) != bufA) return false;
+	if (a(4, 5) != 2 || b(2, 3) != 1) return false;
+
+	// Reallocation of the outer vector must move the grids, not copy them
+	std::vector<vector_n<int, 2>> grids;
+	grids.push_back(std::move(a));
+	allocations = allocationCount;
+	grids.push_back(std::move(b));
+	// Only the outer vector buffer is allocated
+	return allocationCount == allocations + 1 && &grids[0](0, 0) == bufB && &grids[1](0, 0) == bufA;
+}
+
+bool test_aligned_rows()
+{
+	typedef vector_n<float, 3, aligned_allocator<float, 64>> aligned_vector;
+	aligned_vector a(vector_row_alignment(64), 3, 4, 5);
+
+	int val = 0;
+	for (int i1 = 0; i1 < 3; ++i1)
+		for (int i2 = 0; i2 < 4; ++i2)
+		{
+			if (reinterpret_cast<uintptr_t>(&a(i1, i2, 0)) % 64 != 0) return false;
+			for (int i3 = 0; i3 < 5; ++i3) a(i1, i2, i3) = float(val++);
+		}
+
+	aligned_vector b = a;
+	val = 0;
+	for (int i1 = 0; i1 < 3; ++i1)
+		for (int i2 = 0; i2 < 4; ++i2)
+			for (int i3 = 0; i3 < 5; ++i3)
+				if (b(i1, i2, i3) != float(val++)) return false;
+
+	// Padding is kept on resize
+	b.resize(2, 2, 17);
+	return b.row_alignment() == 64 && reinterpret_cast<uintptr_t>(&b(1, 1, 0)) % 64 == 0 &&
+		b.getData().size() == 2 * 2 * 32;
+}
+
+template<class T>
+struct counting_allocator
+{
+	typedef T value_type;
+
+	counting_allocator(size_t *acounter) : counter(acounter) {}
+	template<class U> counting_allocator(const counting_allocator<U> &other) : counter(other.counter) {}
+
+	T *allocate(size_t n)
+	{
+		*counter += n;
+		return std::allocator<T>().allocate(n);
+	}
+
+	void deallocate(T *ptr, size_t n)
+	{
+		std::allocator<T>().deallocate(ptr, n);
+	}
+
+	bool operator==(const counting_allocator &other) const { return counter == other.counter; }
+	bool operator!=(const counting_allocator &other) const { return counter != other.counter; }
+
+	size_t *counter;
+};
+
+bool test_custom_allocator()
+{
+	size_t counter = 0;
+	vector_n<int, 2, counting_allocator<int>> a{counting_allocator<int>(&counter)};
+	a.resize(3, 4);
+	a(2, 3) = 5;
+	if (counter != 12 || a(2, 3) != 5 || a.get_allocator().counter != &counter) return false;
+
+	// The sizing constructor allocates through the given allocator
+	size_t other = 0;
+	const vector_n<int, 3, counting_allocator<int>> b(counting_allocator<int>(&other), 2, 3, 4);
+	vector_n<int, 2, counting_allocator<int>> c(a.get_allocator(), 5, 2);
+	return other == 24 && b.get_allocator().counter == &other && b(1, 2, 3) == 0 && counter == 22 &&
+		c.size() == vector_size<2>{5, 2};
+}
+
+bool test_slice()
+{
+	vector_n<int, 3> a(6, 4, 10);
+	{
+		int val = 0;
+		for (int i1 = 0; i1 < 6; ++i1)
+			for (int i2 = 0; i2 < 4; ++i2)
+				for (int i3 = 0; i3 < 10; ++i3) a(i1, i2, i3) = val++;
+	}
+
+	auto s = a.slice({{1, 5}, {}, {1, 100, 3}});
+	if (s.size() != vector_size<3>{4, 4, 3}) return false;
+
+	for (int i1 = 0; i1 < 4; ++i1)
+		for (int i2 = 0; i2 < 4; ++i2)
+			for (int i3 = 0; i3 < 3; ++i3)
+				if (&s(i1, i2, i3) != &a(i1 + 1, i2, i3 * 3 + 1)) return false;
+
+	// Slices are composable with fix, slice and get_indexer
+	auto f = s.fix<1>(2);
+	for (int i1 = 0; i1 < 4; ++i1)
+		for (int i3 = 0; i3 < 3; ++i3)
+			if (f(i1, i3) != a(i1 + 1, 2, i3 * 3 + 1)) return false;
+
+	auto ss = s.slice({{4, 4}, {0, 4, 2}, {1, 3}});
+	if (ss.size() != vector_size<3>{0, 2, 2}) return false;
+
+	try
+	{
+		s.slice({{3, 1}, {}, {}});
+		return false;
+	}
+	catch (const std::invalid_argument &) {}
+
+	size_t count = 0;
+	for (auto x : s.get_indexer<2, 0, 1>())
+	{
+		if (x.value != a(x.index[1] + 1, x.index[2], x.index[0] * 3 + 1)) return false;
+		++count;
+	}
+	return count == 4 * 4 * 3;
+}
+
+bool test_parallel_for_each()
+{
+	vector_n<int, 3> a(7, 5, 3);
+	parallel_for_each(a.get_indexer_mut<2, 0, 1>(), [](auto x)
+	{
+		x.value = int(x.index[0] * 100 + x.index[1] * 10 + x.index[2]);
+	}, 4);
+	for (int i1 = 0; i1 < 7; ++i1)
+		for (int i2 = 0; i2 < 5; ++i2)
+			for (int i3 = 0; i3 < 3; ++i3)
+				if (a(i1, i2, i3) != i3 * 100 + i1 * 10 + i2) return false;
+
+	// Every worker gets its own sub-slice
+	vector_n<int, 2> sums(5, 7);
+	parallel_for_each(a.get_indexer_mut<1, 0>(), [&](auto x)
+	{
+		int sum = 0;
+		for (auto y : x.value.template get_indexer<0>()) sum += y.value;
+		sums(x.index[0], x.index[1]) = sum;
+	}, 3);
+	for (int i1 = 0; i1 < 7; ++i1)
+		for (int i2 = 0; i2 < 5; ++i2)
+			if (sums(i2, i1) != a(i1, i2, 0) + a(i1, i2, 1) + a(i1, i2, 2)) return false;
+
+	// Exceptions are passed to the caller
+	try
+	{
+		parallel_for_each(a.get_indexer<0>(), [](auto x)
+		{
+			if (x.index[0] == 6) throw std::runtime_error("error");
+		}, 2);
+		return false;
+	}
+	catch (const std::runtime_error &) {}
+
+	return true;
+}
+
+bool test_for_each()
+{
+	vector_n<int, 3> a(3, 4, 5);
+	int val = 0;
+	for_each<2, 0, 1>(a, [&](int &x) { x = val++; });
+
+	// The same order as get_indexer
+	val = 0;
+	for (auto x : a.get_indexer<2, 0, 1>())
+	{
+		if (x.value != val++) return false;
+	}
+
+	// Natural order on a const strided slice
+	const auto s = a.slice({{}, {1, 4, 2}, {}});
+	std::vector<int> visited;
+	for_each(s, [&](const int &x) { visited.push_back(x); });
+	std::vector<int> expected;
+	for (int i1 = 0; i1 < 3; ++i1)
+		for (int i2 = 1; i2 < 4; i2 += 2)
+			for (int i3 = 0; i3 < 5; ++i3) expected.push_back(a(i1, i2, i3));
+
+	return visited == expected;
+}
+
+bool test_permute()
+{
+	vector_n<int, 3> a(37, 53, 29);
+	for_each(a, [n = 0](int &x) mutable { x = n++; });
+
+	auto view = a.permuted_view<2, 0, 1>();
+	if (view.size() != vector_size<3>{29, 37, 53} || &view(3, 4, 5) != &a(4, 5, 3)) return false;
+
+	auto b = a.permute<2, 0, 1>();
+	if (b.size() != vector_size<3>{29, 37, 53}) return false;
+
+	// The copy has the natural layout and the order of get_indexer
+	auto it = b.begin();
+	for (auto x : a.get_indexer<2, 0, 1>())
+	{
+		if (*it++ != x.value) return false;
+	}
+
+	// Permutation of a strided slice
+	auto c = a.slice({{1, 30, 3}, {}, {2, 20}}).permute<1, 2, 0>();
+	for (int i1 = 0; i1 < 53; ++i1)
+		for (int i2 = 0; i2 < 18; ++i2)
+			for (int i3 = 0; i3 < 10; ++i3)
+				if (c(i1, i2, i3) != a(1 + i3 * 3, i1, i2 + 2)) return false;
+
+	return true;
+}
+
+bool test_expressions()
+{
+	vector_n<double, 3> a(3, 4, 5), b(3, 4, 5), c(3, 4, 5);
+	int val = 0;
+	for_each(a, [&](double &x) { x = val++; });
+	for_each(b, [&](double &x) { x = val++ * 0.5; });
+
+	c = a * b + 2.0 * a - b / 4 + 1;
+	for (int i1 = 0; i1 < 3; ++i1)
+		for (int i2 = 0; i2 < 4; ++i2)
+			for (int i3 = 0; i3 < 5; ++i3)
+			{
+				const double x = a(i1, i2, i3), y = b(i1, i2, i3);
+				if (c(i1, i2, i3) != x * y + 2.0 * x - y / 4 + 1) return false;
+			}
+
+	// Strided and permuted operands, writing into a slice
+	vector_n<int, 2> m(4, 6), t(6, 4);
+	val = 0;
+	for_each(m, [&](int &x) { x = val++; });
+	t = -m.permuted_view<1, 0>() + elementwise(t, [](int x) { return x + 10; });
+	auto s = t.slice({{1, 6, 2}, {}});
+	s *= 2;
+	s += m.slice({{}, {0, 6, 2}}).permuted_view<1, 0>();
+	for (int i1 = 0; i1 < 6; ++i1)
+		for (int i2 = 0; i2 < 4; ++i2)
+		{
+			int expected = 10 - m(i2, i1);
+			if (i1 % 2 == 1) expected = expected * 2 + m(i2, (i1 - 1));
+			if (t(i1, i2) != expected) return false;
+		}
+
+	try
+	{
+		c = a + b.slice({{0, 2}, {}, {}});
+		return false;
+	}
+	catch (const std::invalid_argument &) {}
+	return true;
+}
+
+bool test_reductions()
+{
+	vector_n<float, 3> a(7, 9, 70);
+	vector_n<int, 3> b(7, 9, 70);
+	int val = 0;
+	for_each(b, [&](int &x) { x = (val++ * 37) % 101 - 50; });
+	a = b * 1.0f;
+
+	// Integers have the exact sequential result
+	auto check = [&](const auto &s)
+	{
+		long long sum = 0, dot = 0;
+		int mn = *s.origin(), mx = *s.origin();
+		for_each(s, [&](int x) { sum += x; dot += x * x; mn = std::min(mn, x); mx = std::max(mx, x); });
+		return s.sum() == sum && s.dot(s) == dot && s.min_value() == mn && s.max_value() == mx &&
+			std::abs(s.norm() - std::sqrt(double(dot))) < 1e-9;
+	};
+	if (!check(b) || !check(b.fix<1>(3)) || !check(b.slice({{1, 7, 2}, {}, {3, 70, 5}})) ||
+		!check(b.permuted_view<2, 1, 0>().fix<0>(4)))
+		return false;
+
+	// Floats go through the SIMD kernels, values are small integers, so the sums are exact
+	const auto f = a.fix<1>(3);
+	const auto i = b.fix<1>(3);
+	if (f.sum() != float(i.sum()) || f.min_value() != float(i.min_value()) ||
+		f.max_value() != float(i.max_value()) || f.dot(f) != float(i.dot(i)))
+		return false;
+	if (a.sum() != float(b.sum()) || a.dot(a) != float(b.dot(b))) return false;
+
+	// NaN is treated in the same way by the SIMD kernels and the scalar fold: the elements are
+	// skipped, the first element makes the result NaN. The positions are in the last accumulator
+	// of the AVX-512 and the AVX2 loops
+	vector_n<float, 2> rows(2, 1000);
+	for_each(rows, [n = 0](float &x) mutable { x = float((n++ * 37) % 101 - 50); });
+	rows(0, 944) = rows(0, 987) = rows(1, 0) = std::nanf("");
+	const vector_n<float, 1> low = rows.reduce<1>(reduce_min(), 1), high = rows.reduce<1>(reduce_max(), 1);
+	const vector_n<float, 1> lowScalar = rows.reduce<1>([](float acc, float x) { return x < acc ? x : acc; }, 1);
+	const vector_n<float, 1> highScalar = rows.reduce<1>([](float acc, float x) { return acc < x ? x : acc; }, 1);
+	if (low(0) != -50 || high(0) != 50 || lowScalar(0) != -50 || highScalar(0) != 50) return false;
+	if (!std::isnan(low(1)) || !std::isnan(high(1)) || !std::isnan(lowScalar(1)) || !std::isnan(highScalar(1))) return false;
+	if (rows.fix<0>(0).min_value() != -50 || !std::isnan(rows.fix<0>(1).max_value())) return false;
+
+	vector_n<double, 1> empty(0);
+	try
+	{
+		empty.min_value();
+		return false;
+	}
+	catch (const std::invalid_argument &) {}
+	return empty.sum() == 0;
+}
+
+bool test_fixed_extents()
+{
+	// Everything is static, the elements are stored inline
+	vector_n_fixed<float, 3, 3, 3> small;
+	static_assert(sizeof(small) < sizeof(float) * 27 + sizeof(impl::VectorSlice<float, 3>), "Elements must be inline");
+	small(1, 2, 0) = 5;
+	if (small.begin()[1 * 9 + 2 * 3] != 5 || small.size() != vector_size<3>{3, 3, 3}) return false;
+
+	// Mixed static and dynamic extents
+	vector_n_fixed<int, 4, vector_n_dynamic, 3> a(7);
+	static_assert(sizeof(vector_n_fixed_view<int, 4, vector_n_dynamic, 3>) < sizeof(impl::VectorSlice<int, 3>), 
+		"View must be smaller");
+	vector_n<int, 3> b(4, 7, 3);
+	int val = 0;
+	for (int i1 = 0; i1 < 4; ++i1)
+		for (int i2 = 0; i2 < 7; ++i2)
+			for (int i3 = 0; i3 < 3; ++i3)
+			{
+				a(i1, i2, i3) = val;
+				b(i1, i2, i3) = val++;
+			}
+	if (a.size(2) != 7 || !std::equal(a.begin(), a.end(), b.begin())) return false;
+
+	// Views over the same memory
+	const vector_n_fixed<int, 4, vector_n_dynamic, 3> &ca = a;
+	vector_n_fixed_view<const int, 4, vector_n_dynamic, 3> v(ca.begin(), 7);
+	if (&v(3, 6, 2) != &ca(3, 6, 2)) return false;
+	auto f = a.view().fix<1>(5);
+	if (f.sum() != b.fix<1>(5).sum() || &f(2, 1) != &a(2, 5, 1)) return false;
+	static_assert(std::is_same_v<decltype(ca.view()(0, 0, 0)), const int &> && std::is_same_v<decltype(ca.origin()), const int *>,
+		"Constant array must give only constant elements");
+	if (ca.view().fix<1>(5).sum() != f.sum() || ca.origin() != a.origin()) return false;
+
+	try
+	{
+		a.at(0, 7, 0);
+		return false;
+	}
+	catch (const std::out_of_range &) {}
+
+	auto moved = std::move(a);
+	return moved(3, 6, 2) == b(3, 6, 2) && a.size(2) == 0;
+}
+
+bool test_mapped()
+{
+	const char *path = "vector_n_test_mapped.bin";
+	vector_n<int, 3> expected(3, 4, 5);
+	{
+		auto a = vector_n_mapped<int, 3>::create(path, 3, 4, 5);
+		if (a.sum() != 0) return false;
+		int val = 0;
+		for (int i1 = 0; i1 < 3; ++i1)
+			for (int i2 = 0; i2 < 4; ++i2)
+				for (int i3 = 0; i3 < 5; ++i3)
+				{
+					a(i1, i2, i3) = val;
+					expected(i1, i2, i3) = val++;
+				}
+		a.advise(vector_n_advice::sequential);
+		a.flush();
+	}
+
+	bool res = true;
+	{
+		vector_n_mapped<const int, 3> b(path);
+		res = b.size() == expected.size() && b.sum() == expected.sum() && b(2, 3, 4) == expected(2, 3, 4)
+			&& b.fix<2>(1).sum() == expected.fix<2>(1).sum();
+
+		// Moved-from object is empty
+		auto c = std::move(b);
+		res = res && !b.is_open() && c.is_open() && c(1, 2, 3) == expected(1, 2, 3);
+	}
+
+	// Element type must match
+	try
+	{
+		vector_n_mapped<float, 3> d(path);
+		res = false;
+	}
+	catch (const std::runtime_error &) {}
+
+	// Damaged copies: cut inside the extents, and the extents which overflow the element count
+	std::vector<char> bytes;
+	if (std::FILE *in = std::fopen(path, "rb"))
+	{
+		char buf[256];
+		for (size_t n; (n = std::fread(buf, 1, sizeof(buf), in)) != 0;) bytes.insert(bytes.end(), buf, buf + n);
+		std::fclose(in);
+	}
+	const char *damagedPath = "vector_n_test_damaged.bin";
+	auto rejected = [&](size_t length)
+	{
+		if (std::FILE *out = std::fopen(damagedPath, "wb"))
+		{
+			std::fwrite(bytes.data(), 1, length, out);
+			std::fclose(out);
+		}
+		try
+		{
+			vector_n_mapped<const int, 3> e(damagedPath);
+			return false;
+		}
+		catch (const std::runtime_error &)
+		{
+			return true;
+		}
+	};
+	const size_t headerBytes = 8 + 4 * 4 + 8;
+	res = res && rejected(headerBytes + 8);
+	const uint64_t huge[3] = {uint64_t(1) << 62, uint64_t(1) << 62, 4};
+	std::memcpy(bytes.data() + headerBytes, huge, sizeof(huge));
+	res = res && rejected(bytes.size());
+	// An empty file is rejected after it was opened, the descriptor is closed
+	if (std::FILE *out = std::fopen(damagedPath, "wb")) std::fclose(out);
+	for (int i = 0; i < 3 && res; ++i) res = rejected(0);
+	std::remove(damagedPath);
+
+	// The file size would overflow
+	try
+	{
+		vector_n_mapped<int, 3>::create(damagedPath, size_t(1) << 40, size_t(1) << 20, 16);
+		res = false;
+	}
+	catch (const std::invalid_argument &) {}
+	std::remove(damagedPath);
+
+	std::remove(path);
+	return res;
+}
+
+bool test_npy()
+{
+	vector_n<double, 3> a(5, 6, 7);
+	int val = 0;
+	for (int i1 = 0; i1 < 5; ++i1)
+		for (int i2 = 0; i2 < 6; ++i2)
+			for (int i3 = 0; i3 < 7; ++i3) a(i1, i2, i3) = val++;
+
+	// Dense round trip, the data begins at the multiple of 64 bytes
+	std::stringstream dense;
+	save_npy(dense, a);
+	const std::string file = dense.str();
+	if (file.compare(0, 6, "\x93NUMPY") != 0 || (file.size() - 5 * 6 * 7 * sizeof(double)) % 64 != 0) return false;
+	if (file.find("'shape': (5, 6, 7)") == std::string::npos) return false;
+	auto b = load_npy<double, 3>(dense);
+	if (b.size() != a.size() || !std::equal(a.begin(), a.end(), b.begin())) return false;
+
+	// Strided views are written through the small buffer
+	auto s = a.slice({{1, 5}, {}, {1, 100, 3}}).fix<1>(2);
+	std::stringstream strided;
+	save_npy(strided, s, 5 * sizeof(double));
+	auto c = load_npy<double, 2>(strided);
+	if (c.size() != s.size()) return false;
+	for (int i1 = 0; i1 < 4; ++i1)
+		for (int i3 = 0; i3 < 2; ++i3)
+			if (c(i1, i3) != s(i1, i3)) return false;
+
+	// Loading into the strided view
+	vector_n<double, 3> d(5, 6, 7);
+	strided.clear();
+	strided.seekg(0);
+	load_npy(strided, d.slice({{1, 5}, {}, {1, 100, 3}}).fix<1>(2), 5 * sizeof(double));
+	if (d(3, 2, 4) != a(3, 2, 4) || d(3, 2, 5) != 0 || d.sum() != s.sum()) return false;
+
+	// Fortran order is the transposed C order
+	std::string header = "{'descr': '" + impl::npy_descr<int>() + "', 'fortran_order': True, 'shape': (2, 3), }";
+	std::string fortran = std::string("\x93NUMPY\x01\x00", 8) + char(header.size()) + '\0' + header;
+	const int values[6] = {0, 3, 1, 4, 2, 5};
+	fortran.append(reinterpret_cast<const char*>(values), sizeof(values));
+	std::istringstream fortranIn(fortran);
+	auto e = load_npy<int, 2>(fortranIn);
+	if (e(0, 0) != 0 || e(0, 2) != 2 || e(1, 0) != 3 || e(1, 2) != 5) return false;
+
+	try
+	{
+		dense.clear();
+		dense.seekg(0);
+		load_npy<float, 3>(dense);
+		return false;
+	}
+	catch (const std::runtime_error &) {}
+
+	// The elements aren't zeroed before the reading with default_init_allocator
+	dense.clear();
+	dense.seekg(0);
+	const auto f = load_npy<double, 3, default_init_allocator<std::allocator<double>>>(dense);
+	if (f.init_mode() != vector_n_init::none || !std::equal(a.begin(), a.end(), f.begin())) return false;
+
+	// Headers longer than numpy accepts are rejected before the allocation
+	std::string huge = std::string("\x93NUMPY\x02\x00", 8) + std::string("\x00\x00\x00\x40", 4);
+	std::istringstream hugeIn(huge);
+	try
+	{
+		load_npy<int, 2>(hugeIn);
+		return false;
+	}
+	catch (const std::runtime_error &) {}
+	return true;
+}
+
+bool test_view()
+{
+	int buffer[24];
+	for (int i = 0; i < 24; ++i) buffer[i] = i;
+
+	vector_n_view<int, 3> a(buffer, 2, 3, 4);
+	if (&a(1, 2, 3) != buffer + 23 || a.size() != vector_size<3>{2, 3, 4}) return false;
+
+	int sum = 0;
+	for (auto x : a.get_indexer<2, 0, 1>()) sum += x.value;
+	if (sum != 23 * 24 / 2 || a.fix<0>(1)(2, 3) != 23) return false;
+
+	try
+	{
+		a.at(1, 3, 0);
+		return false;
+	}
+	catch (const std::out_of_range &) {}
+
+	// Same buffer seen as column-major 4x3x2 array
+	const int *cbuffer = buffer;
+	vector_n_view<const int, 3> t(cbuffer, {4, 3, 2}, {1, 4, 12});
+	for (int i1 = 0; i1 < 2; ++i1)
+		for (int i2 = 0; i2 < 3; ++i2)
+			for (int i3 = 0; i3 < 4; ++i3)
+				if (&t(i3, i2, i1) != &a(i1, i2, i3)) return false;
+
+	// Writes go to the buffer, slices keep pointing to it
+	vector_n_view<int, 2> f = a.fix<1>(1);
+	f(1, 2) = -1;
+	int other[24] = {};
+	a.rebind(other);
+	return buffer[1 * 12 + 1 * 4 + 2] == -1 && a.at(1, 2, 3) == 0;
+}
+
+bool test_element_iterator()
+{
+	vector_n<int, 3> a(3, 4, 5);
+	int val = 60;
+	for (auto &x : a) x = val--;
+
+	// Traversal order 2, 0, 1 like get_indexer<2, 0, 1>
+	auto r = a.elements<2, 0, 1>();
+	static_assert(std::is_same_v<std::iterator_traits<decltype(r.begin())>::iterator_category,
+		std::random_access_iterator_tag>, "Iterator must be random-access");
+	if (r.size() != 60 || r.end() - r.begin() != 60) return false;
+	auto it = r.begin();
+	for (auto x : a.get_indexer<2, 0, 1>())
+	{
+		const auto pos = it.position();
+		if (&*it != &x.value || &a(pos[0], pos[1], pos[2]) != &x.value) return false;
+		++it;
+	}
+	if (it != r.end()) return false;
+
+	// Jumps and moves backwards agree with the increments
+	for (size_t n = 0; n < 60; n += 7)
+	{
+		auto jump = r.begin() + n;
+		auto back = r.end();
+		for (size_t i = 60; i != n; --i) --back;
+		if (&*jump != &*back || &r.begin()[n] != &*jump || jump.index() != n) return false;
+	}
+
+	// Standard algorithms over a strided slice
+	auto s = a.slice({{}, {1, 3}, {0, 5, 2}});
+	auto e = s.elements();
+	std::sort(e.begin(), e.end());
+	if (!std::is_sorted(e.begin(), e.end()) || &*e.begin() != &a(0, 1, 0) || a(2, 2, 4) != 55 || a(2, 3, 0) != 5)
+		return false;
+	const int sum = s.sum();
+	std::transform(e.begin(), e.end(), e.begin(), [](int x) { return -x; });
+	if (std::accumulate(e.begin(), e.end(), 0) != -sum || s.sum() != -sum) return false;
+
+	const vector_n<int, 3> &ca = a;
+	return std::count(ca.elements<1, 2, 0>().begin(), ca.elements<1, 2, 0>().end(), 0) == 0 &&
+		*(ca.elements().end() - 1) == ca(2, 3, 4);
+}
+
+bool test_indexer_ranges()
+{
+	vector_n<int, 3> a(4, 5, 6);
+	int val = 0;
+	for (auto &x : a) x = val++;
+
+	// Interior cells, rows in reverse order, every second column
+	std::vector<int> expected;
+	for (int i2 = 3; i2 >= 1; --i2)
+		for (int i1 = 1; i1 < 3; ++i1)
+			for (int i3 = 0; i3 < 6; i3 += 2) expected.push_back(a(i1, i2, i3));
+
+	auto indexer = a.get_indexer_mut<1, 0, 2>();
+	indexer.range(0, 1, 3).range(1, 1, 4).rev(1).step(2, 2);
+	if (indexer.count() != expected.size()) return false;
+
+	std::vector<int> visited;
+	for (auto x : indexer)
+	{
+		if (x.value != a(x.index[1], x.index[0], x.index[2])) return false;
+		visited.push_back(x.value);
+	}
+	if (visited != expected) return false;
+
+	for (size_t n = 0; n != expected.size(); ++n)
+	{
+		if ((*indexer.iterator_at(n)).value != expected[n]) return false;
+	}
+
+	// Reversed stepped range starts from the last visited position
+	std::vector<int> column;
+	auto partial = a.get_indexer<2>();
+	for (auto x : partial.range(2, 1, 6).step(2, 2).rev(2)) column.push_back(x.value(0, 0));
+	if (column != std::vector<int>{5, 3, 1}) return false;
+
+	parallel_for_each(a.get_indexer_mut<0, 2>().range(2, 2, 4).rev(0), [](auto x)
+	{
+		x.value(0) += 1000;
+	}, 2);
+	for (int i1 = 0; i1 < 4; ++i1)
+		for (int i3 = 0; i3 < 6; ++i3)
+			if ((a(i1, 0, i3) >= 1000) != (i3 == 2 || i3 == 3)) return false;
+
+	// Empty range has no positions
+	auto empty = a.get_indexer<0, 1, 2>();
+	empty.range(1, 2, 2);
+	if (empty.begin() != empty.end() || empty.count() != 0) return false;
+
+	try
+	{
+		a.get_indexer<0, 1>().range(2, 0, 1);
+		return false;
+	}
+	catch (const std::invalid_argument &) {}
+	try
+	{
+		a.get_indexer<0, 1>().range(1, 0, 6);
+		return false;
+	}
+	catch (const std::out_of_range &) {}
+	return true;
+}
+
+bool test_init_modes()
+{
+	vector_n<double, 3> a(vector_n_init::first_touch, 50, 40, 30);
+	if (a.init_mode() != vector_n_init::first_touch || a.sum() != 0) return false;
+	a.fix<0>(49)(39, 29) = 1;
+	a.resize(60, 40, 30);
+	if (a.sum() != 1 || a(59, 39, 29) != 0) return false;
+
+	auto b = a;
+	if (b.init_mode() != vector_n_init::first_touch) return false;
+
+	// The contents are unspecified, but the shape and the writes are as usual
+	vector_n<int, 2, aligned_allocator<int>> c(vector_row_alignment(64), vector_n_init::none, 100, 3);
+	if (c.size() != vector_size<2>{100, 3} || c.strides()[0] != 16) return false;
+	for (auto &x : c) x = 7;
+	if (c.sum() != 7 * 300) return false;
+
+	// Non-trivial types are constructed anyway
+	vector_n<std::string, 2> d(vector_n_init::none, 3, 4);
+	vector_n<std::string, 2> e(vector_n_init::first_touch, 3, 4);
+	for (int i1 = 0; i1 < 3; ++i1)
+		for (int i2 = 0; i2 < 4; ++i2)
+			if (!d(i1, i2).empty() || !e(i1, i2).empty()) return false;
+
+	vector_n<int, 2> f(10, 10);
+	if (f.init_mode() != vector_n_init::value || f.sum() != 0) return false;
+
+	// The storage stays a plain vector, so its own resize zeroes the new elements
+	std::vector<int> &raw = f.getData();
+	raw.resize(raw.size() + 50, 0);
+	raw.resize(raw.size() + 50);
+	if (std::count(raw.begin(), raw.end(), 0) != 200) return false;
+
+	// default_init_allocator skips the serial zeroing, first_touch writes the zeros in parallel
+	vector_n<double, 3, default_init_allocator<std::allocator<double>>> g(vector_n_init::first_touch, 30, 20, 10);
+	vector_n<int, 2, default_init_allocator<aligned_allocator<int>>> h(vector_row_alignment(64), vector_n_init::none, 100, 3);
+	for (auto &x : h) x = 2;
+	if (g.sum() != 0 || h.sum() != 2 * 300 || reinterpret_cast<uintptr_t>(&h(1, 0)) % 64 != 0) return false;
+
+	// Padded rows are split between the threads whole, the padding is zeroed too
+	vector_n<float, 2, default_init_allocator<aligned_allocator<float>>> k(vector_row_alignment(64), vector_n_init::first_touch, 3000, 70);
+	if (k.strides()[0] != 80 || k.sum() != 0 || std::count(k.begin(), k.end(), 0.0f) != 3000 * 80) return false;
+	k.resize(4000, 70);
+	return k.sum() == 0 && std::count(k.begin(), k.end(), 0.0f) == 4000 * 80;
+}
+
+bool test_layout()
+{
+	vector_n<int, 3> a(3, 4, 5);
+	vector_n<int, 3> c(vector_layout<3>::column_major(), 3, 4, 5);
+	if (c.strides() != vector_size<3>{1, 3, 12} || c.size() != a.size()) return false;
+
+	int val = 0;
+	for (int i1 = 0; i1 < 3; ++i1)
+		for (int i2 = 0; i2 < 4; ++i2)
+			for (int i3 = 0; i3 < 5; ++i3) a(i1, i2, i3) = val++;
+
+	// Indexes are logical, the layout only changes the memory order
+	c = a * 2;
+	for (int i1 = 0; i1 < 3; ++i1)
+		for (int i2 = 0; i2 < 4; ++i2)
+			for (int i3 = 0; i3 < 5; ++i3)
+				if (c(i1, i2, i3) != 2 * a(i1, i2, i3)) return false;
+	if (c.begin()[1] != c(1, 0, 0) || c.fix<2>(1).strides() != vector_size<2>{1, 3}) return false;
+	if (c.fix<0>(2).sum() != 2 * a.fix<0>(2).sum() || c.dot(a) != 2 * a.dot(a)) return false;
+
+	// Default for_each goes through memory
+	std::vector<int> visited;
+	for_each(c, [&](int x) { visited.push_back(x); });
+	if (!std::equal(visited.begin(), visited.end(), c.begin())) return false;
+
+	vector_n<int, 3> d(vector_layout<3>({1, 0, 2}), 3, 4, 5);
+	d = c + 0;
+	if (d.strides() != vector_size<3>{5, 15, 1} || d(2, 3, 4) != c(2, 3, 4)) return false;
+
+	// Column-major arrays are saved with the Fortran order
+	std::stringstream stream;
+	save_npy(stream, c);
+	if (stream.str().find("'fortran_order': True") == std::string::npos) return false;
+	auto loaded = load_npy<int, 3>(stream);
+	for (int i1 = 0; i1 < 3; ++i1)
+		for (int i2 = 0; i2 < 4; ++i2)
+			for (int i3 = 0; i3 < 5; ++i3)
+				if (loaded(i1, i2, i3) != c(i1, i2, i3)) return false;
+
+	c.resize(2, 2, 2);
+	if (c.layout() != vector_layout<3>::column_major() || c.strides() != vector_size<3>{1, 2, 4}) return false;
+
+	// The padding goes to the contiguous dimension
+	vector_n<float, 2, aligned_allocator<float>> p(vector_layout<2>::column_major(), vector_row_alignment(64), 5, 3);
+	vector_n<float, 2, aligned_allocator<float>> q(vector_row_alignment(64), 5, 3);
+	if (p.strides() != vector_size<2>{1, 16} || q.strides() != vector_size<2>{16, 1}) return false;
+	if (reinterpret_cast<uintptr_t>(&p(0, 2)) % 64 != 0 || p.row_alignment() != 64) return false;
+	p.resize(7, 2);
+	if (p.strides() != vector_size<2>{1, 16}) return false;
+
+	// All options together
+	vector_n<float, 3, aligned_allocator<float>> r(vector_layout<3>({2, 0, 1}), vector_row_alignment(32), vector_n_init::none, 3, 4, 5);
+	if (r.strides() != vector_size<3>{8, 1, 24} || r.init_mode() != vector_n_init::none || r.layout().order[2] != 1) return false;
+
+	try
+	{
+		vector_layout<3>({0, 2, 2});
+		return false;
+	}
+	catch (const std::invalid_argument &) {}
+	return true;
+}
+
+bool test_tiled()
+{
+	vector_n<int, 3> a(19, 10, 9);
+	vector_n_tiled<int, 3, 4> t(19, 10, 9);
+	int val = 0;
+	for (int i1 = 0; i1 < 19; ++i1)
+		for (int i2 = 0; i2 < 10; ++i2)
+			for (int i3 = 0; i3 < 9; ++i3)
+			{
+				a(i1, i2, i3) = val;
+				t(i1, i2, i3) = val++;
+			}
+	if (t.brick_count() != vector_size<3>{5, 3, 3} || t.end() - t.begin() != 5 * 3 * 3 * 64) return false;
+
+	// Neighbours in every dimension are inside the same brick
+	if (&t(5, 5, 5) - &t(4, 4, 4) != 7 || &t(0, 0, 1) - &t(0, 0, 0) != 1) return false;
+
+	// Every element is written once, the padding isn't touched
+	std::vector<int> visited;
+	t.for_each([&](int &x) { visited.push_back(x); });
+	std::sort(visited.begin(), visited.end());
+	for (int i = 0; i < val; ++i)
+		if (visited[i] != i) return false;
+	if (int(visited.size()) != val || std::count(t.begin(), t.end(), 0) != 5 * 3 * 3 * 64 - val + 1) return false;
+
+	size_t covered = 0;
+	t.for_each_brick([&](const vector_size<3> &from, const vector_size<3> &to)
+	{
+		covered += (to[0] - from[0]) * (to[1] - from[1]) * (to[2] - from[2]);
+	});
+	if (covered != size_t(val)) return false;
+
+	// Fixed slices use the same tables
+	auto f = t.fix<0, 2>(17, 3);
+	int sum = 0;
+	f.for_each([&](int x) { sum += x; });
+	if (f.size(1) != 10 || sum != a.fix<0, 2>(17, 3).sum() || f(7) != a(17, 7, 3)) return false;
+
+	f(7) = -1;
+	if (t(17, 7, 3) != -1) return false;
+	t(17, 7, 3) = a(17, 7, 3);
+
+	const auto copy = t;
+	if (copy(18, 9, 8) != a(18, 9, 8) || &copy(1, 1, 1) == &t(1, 1, 1)) return false;
+
+	// Slices of the constant array are constant, the index order goes like the nested loops
+	auto row = copy.fix<0>(4);
+	static_assert(std::is_same_v<decltype(row(0, 0)), const int &>, "Slice of a constant array must be constant");
+	std::vector<int> ordered;
+	row.for_each([&](int x) { ordered.push_back(x); });
+	copy.for_each_index_order([&](const int &x) { ordered.push_back(x); });
+	if (ordered.size() != 90 + size_t(val)) return false;
+	for (int i = 0; i < 90; ++i)
+		if (ordered[i] != a(4, i / 9, i % 9)) return false;
+	for (int i = 0; i < val; ++i)
+		if (ordered[90 + i] != i) return false;
+	try
+	{
+		copy.at(19, 0, 0);
+		return false;
+	}
+	catch (const std::out_of_range &) {}
+
+	auto moved = std::move(t);
+	if (moved.fix<1>(2)(3, 4) != a(3, 2, 4) || t.size() != vector_size<3>{}) return false;
+
+	// Assignments and swap between different extents take the sizes with the bricks
+	vector_n_tiled<int, 2> small(4, 4), large(40, 40);
+	large(39, 39) = 7;
+	small = large;
+	if (small.size() != vector_size<2>{40, 40} || small(39, 39) != 7) return false;
+	vector_n_tiled<int, 2> target(3, 3);
+	target = std::move(small);
+	if (target.size() != vector_size<2>{40, 40} || target(39, 39) != 7) return false;
+	vector_n_tiled<int, 2> d(2, 2), e(20, 20);
+	e(19, 19) = 3;
+	swap(d, e);
+	if (d.size() != vector_size<2>{20, 20} || e.size() != vector_size<2>{2, 2} || d(19, 19) != 3) return false;
+	large = e;
+	return large.size() == vector_size<2>{2, 2} && large.brick_count() == e.brick_count();
+}
+
+bool test_stencil()
+{
+	const int s1 = 37, s2 = 21;
+	vector_n<int, 2> a(s1, s2), b(s1, s2);
+	for (int i1 = 0; i1 < s1; ++i1)
+		for (int i2 = 0; i2 < s2; ++i2) a(i1, i2) = (i1 * 7 + i2 * 3) % 11;
+
+	auto kernel = [](const auto &n)
+	{
+		return n.template get<-1, 0>() + 2 * n.template get<1, 0>() + 3 * n.template get<0, -1>() + 4 * n(0, 1) + 5 * n(0, 0);
+	};
+	auto reference = [&](vector_n_boundary boundary, int i1, int i2)
+	{
+		auto get = [&](int j1, int j2)
+		{
+			if (j1 >= 0 && j1 < s1 && j2 >= 0 && j2 < s2) return a(j1, j2);
+			if (boundary == vector_n_boundary::constant) return -1;
+			if (boundary == vector_n_boundary::clamp) return a(std::min(std::max(j1, 0), s1 - 1), std::min(std::max(j2, 0), s2 - 1));
+			return a((j1 + s1) % s1, (j2 + s2) % s2);
+		};
+		return get(i1 - 1, i2) + 2 * get(i1 + 1, i2) + 3 * get(i1, i2 - 1) + 4 * get(i1, i2 + 1) + 5 * get(i1, i2);
+	};
+
+	for (auto boundary : {vector_n_boundary::clamp, vector_n_boundary::periodic, vector_n_boundary::constant, vector_n_boundary::skip})
+	{
+		for_each(b, [](int &x) { x = 1000; });
+		apply_stencil<1>(a, b, kernel, boundary, -1);
+		for (int i1 = 0; i1 < s1; ++i1)
+			for (int i2 = 0; i2 < s2; ++i2)
+			{
+				const bool border = i1 == 0 || i2 == 0 || i1 == s1 - 1 || i2 == s2 - 1;
+				const int expected = boundary == vector_n_boundary::skip && border ? 1000 : reference(boundary, i1, i2);
+				if (b(i1, i2) != expected) return false;
+			}
+	}
+
+	// Strided source and destination, a single thread
+	vector_n<int, 2> c(s2, s1);
+	apply_stencil<1>(a, c.permuted_view<1, 0>(), kernel, vector_n_boundary::periodic, 0, 1);
+	if (c(5, 0) != reference(vector_n_boundary::periodic, 0, 5) || c(20, 36) != reference(vector_n_boundary::periodic, 36, 20)) return false;
+
+	// The interior is empty along a dimension, everything goes through the boundary path
+	vector_n<int, 3> d(40, 2, 50), e(40, 2, 50);
+	for_each(d, [](int &x) { x = 3; });
+	apply_stencil<1>(d, e, [](const auto &n) { return n(-1, 1, 0) + n(1, -1, 1); }, vector_n_boundary::clamp);
+	if (e.min_value() != 6 || e.max_value() != 6) return false;
+
+	try
+	{
+		apply_stencil<1>(a, d.fix<1>(0), kernel);
+		return false;
+	}
+	catch (const std::invalid_argument &) {}
+
+	// Heat diffusion with fixed borders: the hot border spreads inside, the borders stay
+	vector_n<double, 2> t(30, 30), buffer;
+	for_each(t, [](double &x) { x = 0; });
+	auto top = t.fix<0>(0);
+	for_each(top, [](double &x) { x = 100; });
+	iterate_stencil<1>(t, buffer, 500, [](const auto &n)
+	{
+		return 0.25 * (n(-1, 0) + n(1, 0) + n(0, -1) + n(0, 1));
+	}, vector_n_boundary::skip);
+	if (t(0, 15) != 100 || t(29, 15) != 0 || t(1, 15) <= t(2, 15) || t(2, 15) <= t(20, 15) || t(20, 15) <= 0) return false;
+
+	// A reused buffer of the same sizes gets the border of the array, after an odd number of steps too
+	vector_n<int, 2> g(9, 12), reused(9, 12);
+	for_each(g, [n = 0](int &x) mutable { x = n++; });
+	for_each(reused, [](int &x) { x = -1; });
+	const vector_n<int, 2> initial = g;
+	iterate_stencil<2>(g, reused, 3, [](const auto &n) { return n(0, 0) + n(2, -2); }, vector_n_boundary::skip);
+	for (int i1 = 0; i1 < 9; ++i1)
+		for (int i2 = 0; i2 < 12; ++i2)
+		{
+			const bool border = i1 < 2 || i1 >= 7 || i2 < 2 || i2 >= 10;
+			if (border && (g(i1, i2) != initial(i1, i2) || reused(i1, i2) != initial(i1, i2))) return false;
+			if (!border && g(i1, i2) == initial(i1, i2)) return false;
+		}
+	return true;
+}
+
+bool test_instrumentation()
+{
+	vector_n_stats_reset();
+	vector_n<short, 2> a(10, 20);
+	const auto b = a;
+	const auto f = a.fix<0>(3);
+	const auto s = a.slice({{0, 10, 2}, {}});
+	int steps = 0;
+	for (auto x : a.get_indexer<0, 1>()) steps += x.value + 1;
+	try
+	{
+		a.at(10, 0);
+		return false;
+	}
+	catch (const std::out_of_range &) {}
+	if (steps != 200 || f.size(1) != 20 || s.size(1) != 5 || b.size(2) != 20) return false;
+
+	const vector_n_counters c = vector_n_stats<short, 2>();
+#ifdef VECTOR_N_INSTRUMENTATION
+	if (c.allocations != 2 || c.allocated_bytes < 2 * 200 * sizeof(short) || c.copies != 1 ||
+		c.copied_bytes != 200 * sizeof(short) || c.slices < 2 || c.iterator_steps != 200 ||
+		c.iterator_wraps != 11 || c.bounds_failures != 1)
+		return false;
+
+	std::ostringstream dump;
+	vector_n_stats_dump(dump);
+	if (dump.str().find("copies 1 (400 bytes)") == std::string::npos) return false;
+
+	vector_n_stats_reset();
+	return vector_n_stats<short, 2>().copies == 0 && !vector_n_stats_snapshot().empty();
+#else
+	return c.allocations == 0 && c.copies == 0 && c.slices == 0 && vector_n_stats_snapshot().empty();
+#endif
+}
+
+bool test_sparse()
+{
+	vector_n_sparse<float, 4> a(vector_size<4>{40, 30, 21, 10}, -1.0f);
+	const auto &ca = a;
+	if (a.brick_count() != vector_size<4>{10, 8, 6, 3} || a.allocated_bricks() != 0 || ca(39, 29, 20, 9) != -1) return false;
+
+	// Reads through const never allocate, writes allocate one brick each
+	a(0, 0, 0, 0) = 1;
+	a(1, 2, 3, 3) = 2;
+	a(39, 29, 20, 9) = 3;
+	if (a.allocated_bricks() != 2 || ca(3, 3, 3, 3) != -1 || ca(1, 2, 3, 3) != 2 || ca(3, 3, 3, 4) != -1) return false;
+	if (a.dense_bytes() != 40 * 30 * 21 * 10 * sizeof(float) || a.memory_bytes() >= a.dense_bytes() / 10) return false;
+
+	// Reads through the non-const array don't allocate either
+	float total = 0;
+	for (int i1 = 0; i1 < 40; ++i1)
+		for (int i2 = 0; i2 < 30; ++i2)
+			for (int i3 = 0; i3 < 21; ++i3)
+				for (int i4 = 0; i4 < 10; ++i4) total += a(i1, i2, i3, i4);
+	if (a.allocated_bricks() != 2 || total != 9 - 40 * 30 * 21 * 10) return false;
+	static_assert(std::is_same_v<decltype(ca.fix<0>(1)(2, 3, 4)), const float &>, "Slice of a constant array must be constant");
+
+	// Slices share the bricks
+	auto f = a.fix<1, 3>(29, 9);
+	if (f.size() != vector_size<2>{40, 21} || f(39, 20) != 3) return false;
+	f(10, 10) = 4;
+	auto g = f.fix<0>(10);
+	if (ca(10, 29, 10, 9) != 4 || g(10) != 4 || ca.fix<0>(10)(29, 10, 9) != 4 || a.allocated_bricks() != 3) return false;
+
+	// Only the allocated bricks are visited, the border brick is cut by the sizes
+	size_t visited = 0, bricks = 0;
+	float sum = 0;
+	a.for_each([&](float &x) { ++visited; sum += x; });
+	ca.for_each_brick([&](const vector_size<4> &from, const vector_size<4> &to)
+	{
+		++bricks;
+		if (to[2] - from[2] != (from[2] == 20 ? 1 : 4)) sum = 1000;
+	});
+	if (bricks != 3 || visited != 4 * 4 * 4 * 4 + 4 * 2 * 1 * 2 + 4 * 2 * 4 * 2 || sum != 10.0f - float(visited - 4)) return false;
+
+	auto copy = a;
+	a(0, 0, 0, 0) = -1;
+	a(1, 2, 3, 3) = -1;
+	a.prune();
+	if (a.allocated_bricks() != 2 || copy.allocated_bricks() != 3 || copy(0, 0, 0, 0) != 1) return false;
+
+	try
+	{
+		a.at(40, 0, 0, 0);
+		return false;
+	}
+	catch (const std::out_of_range &) {}
+
+	const auto moved = std::move(copy);
+	if (moved(1, 2, 3, 3) != 2 || moved.background() != -1 || copy.allocated_bricks() != 0) return false;
+
+	// The background of an integer type, compound assignment allocates
+	vector_n_sparse<int, 2> b(vector_size<2>{4, 4}, 1);
+	b(3, 3) += 2;
+	b(0, 0) = b(3, 3);
+	b.resize(5, 5);
+	return b.allocated_bricks() == 0 && b(4, 4) == 1 && b.size() == vector_size<2>{5, 5};
+}
+
+bool test_chunked()
+{
+	vector_n_chunked<double, 3> a(vector_size<3>{10, 4, 5}, 3);
+	const auto &ca = a;
+	if (a.slab_count() != 4 || a.slab_rows() != 3 || a.committed_slabs() != 0 || ca(9, 3, 4) != 0) return false;
+
+	a(4, 1, 2) = 7;
+	if (a.committed_slabs() != 1 || ca(4, 1, 2) != 7 || ca(3, 0, 0) != 0 || ca(0, 0, 0) != 0) return false;
+
+	// fix works across the slabs
+	auto f = a.fix<2>(2);
+	f(9, 3) = 5;
+	if (f(4, 1) != 7 || ca(9, 3, 2) != 5 || a.committed_slabs() != 2) return false;
+	auto g = ca.fix<0, 1>(4, 1);
+	if (g.size(1) != 5 || g(2) != 7 || a(6, 0, 0) != 0 || a.committed_slabs() != 2) return false;
+	static_assert(std::is_same_v<decltype(g(2)), const double &>, "Slice of a constant array must be constant");
+
+	// Only the committed slabs are visited through const, the last slab has one row
+	size_t rows = 0;
+	ca.for_each_slab([&](size_t first, const vector_n_view<const double, 3> &s)
+	{
+		if (first % 3 != 0 || s.size(2) != 4 || s.size(3) != 5) rows = 1000;
+		rows += s.size(1);
+	});
+	if (rows != 3 + 1) return false;
+
+	// Slabs are ordinary dense views
+	a.for_each_slab([](size_t first, vector_n_view<double, 3> &s)
+	{
+		s += double(first);
+	});
+	if (a.committed_slabs() != 4 || ca(9, 3, 2) != 5 + 9 || ca(4, 1, 2) != 7 + 3 || ca(2, 0, 0) != 0) return false;
+	if (a.slab(3).size() != vector_size<3>{1, 4, 5} || a.memory_bytes() < 10 * 4 * 5 * sizeof(double)) return false;
+
+	double sum = 0;
+	a.for_each([&](double x) { sum += x; });
+	if (sum != 3 * 3 * 20 + 6 * 3 * 20 + 9 * 20 + 7 + 5) return false;
+
+	// Default slabs take about vector_n_slab_bytes
+	vector_n_chunked<float, 2> b(100000, 1000);
+	if (b.slab_rows() != vector_n_slab_bytes / 4000 || b.slab_count() != 6 || b.memory_bytes() > 10000) return false;
+	vector_n_chunked<float, 2> c;
+	c.resize(vector_size<2>{100, 10}, 7);
+	c(50, 5) = 1;
+	c.commit_all(3);
+	if (c.committed_slabs() != 15 || c.slab_count() != 15 || c(50, 5) != 1) return false;
+
+	auto copy = a;
+	a(0, 0, 0) = 1;
+	const auto moved = std::move(copy);
+	return moved(0, 0, 0) == 0 && moved(4, 1, 2) == 10 && copy.slab_count() == 0;
+}
+
+bool test_cow()
+{
+	vector_n_cow<int, 3> a(4, 5, 6);
+	for_each(a.write(), [n = 0](int &x) mutable { x = n++; });
+
+	// Copies share the buffer, nothing is allocated
+	const size_t allocations = allocationCount;
+	vector_n_cow<int, 3> b = a;
+	const vector_n_cow<int, 3> c = b;
+	if (allocationCount != allocations || !a.shared() || a.use_count() != 3) return false;
+	if (&c.read()(0, 0, 0) != &a.read()(0, 0, 0) || c(3, 4, 5) != 119 || c.size(2) != 5) return false;
+
+	// The first write of a shared copy duplicates the buffer, the others keep the old values.
+	// Non-const operator() is a write, so the reads go through const
+	const auto &ca = a, &cb = b;
+	b(1, 2, 3) = -1;
+	if (cb(1, 2, 3) != -1 || ca(1, 2, 3) != 45 || c(1, 2, 3) != 45 || b.shared() || a.use_count() != 2) return false;
+	const int *before = &cb(0, 0, 0);
+	b.write().fix<0>(0)(0, 0) = -2;
+	if (&cb(0, 0, 0) != before || cb(0, 0, 0) != -2 || ca(0, 0, 0) != 0) return false;
+
+	// A snapshot read by another thread while the writer goes on
+	vector_n_cow<int, 3> snapshot = a;
+	long long sum = 0;
+	std::thread reader([snapshot, &sum]
+	{
+		for_each(snapshot.read(), [&](int x) { sum += x; });
+	});
+	for_each(a.write(), [](int &x) { x = 0; });
+	reader.join();
+	if (sum != 119 * 120 / 2 || a.read().sum() != 0 || snapshot.read()(3, 4, 5) != 119) return false;
+
+	vector_n_cow<int, 3> moved = std::move(a);
+	if (moved.read()(3, 4, 5) != 0 || a.size() != vector_size<3>{} || a.write().size() != vector_size<3>{}) return false;
+
+	// Move assignment leaves the source empty, not holding the old buffer of the target
+	vector_n_cow<int, 3> target(2, 2, 2);
+	target = std::move(moved);
+	return target.size() == vector_size<3>{4, 5, 6} && moved.size() == vector_size<3>{} && moved.use_count() == 0;
+}
+
+bool test_fill_copy()
+{
+	vector_n<int, 3> a(6, 7, 8), b(6, 7, 8);
+	for_each(a, [n = 0](int &x) mutable { x = n++; });
+
+	// Dense, one memmove
+	b.copy_from(a);
+	if (b(5, 6, 7) != a(5, 6, 7) || b(1, 2, 3) != a(1, 2, 3)) return false;
+
+	// Zero goes through memset, other values through fill, strided slices element by element
+	b.fix<0>(2).fill(0);
+	b.slice({{}, {}, {1, 8, 2}}).fill(-1);
+	for (int i1 = 0; i1 < 6; ++i1)
+		for (int i2 = 0; i2 < 7; ++i2)
+			for (int i3 = 0; i3 < 8; ++i3)
+			{
+				const int expected = i3 % 2 == 1 ? -1 : i1 == 2 ? 0 : a(i1, i2, i3);
+				if (b(i1, i2, i3) != expected) return false;
+			}
+
+	// Permuted source, so no dimension is contiguous in both, and the element type conversion
+	vector_n<double, 3> c(8, 7, 6);
+	c.copy_from(a.permuted_view<2, 1, 0>());
+	if (c(7, 0, 5) != a(5, 0, 7) || c(3, 4, 1) != a(1, 4, 3)) return false;
+
+	// Rows of the inner slices are merged with the outer dimension
+	vector_n<int, 2> d(7, 8);
+	d.copy_from(a.fix<0>(4));
+	if (d(6, 7) != a(4, 6, 7)) return false;
+
+	vector_n<float, 2> e(3, 4);
+	e.assign(1.5f);
+	e.fix<0>(1).assign(d.fix<0>(2).slice({{0, 4}}) * 1.0f);
+	e.fix<0>(2).assign(vector_n<float, 1>(4) + 2.0f);
+	if (e(0, 3) != 1.5f || e(1, 3) != float(d(2, 3)) || e(2, 0) != 2.0f) return false;
+
+	try
+	{
+		b.copy_from(c);
+		return false;
+	}
+	catch (const std::invalid_argument &) {}
+	return true;
+}
+
+bool test_reduce_axes()
+{
+	// Time series of a 3D field, collapsed over time (the outermost axis)
+	vector_n<int, 4> a(5, 4, 3, 6);
+	for_each(a, [n = 0](int &x) mutable { x = (n++ * 37) % 101 - 50; });
+
+	const vector_n<int, 3> total = a.reduce<0>(std::plus<>());
+	const vector_n<int, 3> peak = a.reduce<0>([](int x, int y) { return std::max(x, y); });
+	if (total.size() != vector_size<3>{4, 3, 6}) return false;
+	for (int i1 = 0; i1 < 4; ++i1)
+		for (int i2 = 0; i2 < 3; ++i2)
+			for (int i3 = 0; i3 < 6; ++i3)
+			{
+				int s = 0, m = a(0, i1, i2, i3);
+				for (int t = 0; t < 5; ++t)
+				{
+					s += a(t, i1, i2, i3);
+					m = std::max(m, a(t, i1, i2, i3));
+				}
+				if (total(i1, i2, i3) != s || peak(i1, i2, i3) != m) return false;
+			}
+
+	// The contiguous axis and several axes at once
+	const vector_n<int, 2> rows = a.reduce<1, 3>(std::plus<>());
+	for (int i0 = 0; i0 < 5; ++i0)
+		for (int i2 = 0; i2 < 3; ++i2)
+		{
+			int s = 0;
+			for (int i1 = 0; i1 < 4; ++i1)
+				for (int i3 = 0; i3 < 6; ++i3) s += a(i0, i1, i2, i3);
+			if (rows(i0, i2) != s) return false;
+		}
+
+	// Slices: the result of fix and a permuted view, so no kept axis is contiguous
+	vector_n<double, 3> b(7, 8, 9);
+	for_each(b, [n = 0](double &x) mutable { x = n++ % 13; });
+	const vector_n<double, 1> f = b.fix<1>(3).reduce<1>(std::plus<>());
+	const vector_n<double, 2> p = b.permuted_view<2, 0, 1>().reduce<1>(std::plus<>());
+	const vector_n<double, 2> avg = b.mean<2>();
+	for (int i0 = 0; i0 < 7; ++i0)
+	{
+		double s = 0;
+		for (int i2 = 0; i2 < 9; ++i2) s += b(i0, 3, i2);
+		if (f(i0) != s) return false;
+		for (int i1 = 0; i1 < 8; ++i1)
+		{
+			s = 0;
+			for (int i2 = 0; i2 < 9; ++i2) s += b(i0, i1, i2);
+			if (avg(i0, i1) != s / 9) return false;
+		}
+	}
+	for (int i2 = 0; i2 < 9; ++i2)
+		for (int i1 = 0; i1 < 8; ++i1)
+		{
+			double s = 0;
+			for (int i0 = 0; i0 < 7; ++i0) s += b(i0, i1, i2);
+			if (p(i2, i1) != s) return false;
+		}
+
+	// Large enough to be split between the threads
+	vector_n<float, 3> c(64, 64, 32);
+	for_each(c, [n = 0](float &x) mutable { x = float(n++ % 7); });
+	const vector_n<float, 2> serial = c.reduce<0>(std::plus<>(), 1), parallel = c.reduce<0>(std::plus<>(), 4);
+	const vector_n<float, 2> inner = c.reduce<2>(std::plus<>(), 4);
+	if (serial.size() != parallel.size() || !std::equal(serial.begin(), serial.end(), parallel.begin())) return false;
+	for (int i0 = 0; i0 < 64; i0 += 7)
+	{
+		float s = 0;
+		for (int i2 = 0; i2 < 32; ++i2) s += c(i0, 5, i2);
+		if (inner(i0, 5) != s) return false;
+	}
+
+	// The vectorised folds of the contiguous runs agree with the scalar ones
+	c(9, 3, 17) = -4.5f;
+	c(9, 60, 2) = 11.25f;
+	const vector_n<float, 1> low = c.reduce<1, 2>(reduce_min(), 4), high = c.reduce<1, 2>(reduce_max(), 1);
+	const vector_n<float, 1> lowScalar = c.reduce<1, 2>([](float x, float y) { return std::min(x, y); });
+	const vector_n<float, 1> sums = c.reduce<1, 2>(std::plus<float>(), 4);
+	if (low(9) != -4.5f || high(9) != 11.25f || low(8) != 0 || high(8) != 6) return false;
+	if (!std::equal(low.begin(), low.end(), lowScalar.begin())) return false;
+	for (int i0 = 0; i0 < 64; i0 += 9)
+	{
+		float s = 0;
+		for (int i1 = 0; i1 < 64; ++i1)
+			for (int i2 = 0; i2 < 32; ++i2) s += c(i0, i1, i2);
+		if (sums(i0) != s) return false;
+	}
+
+	// Few elements in the outermost kept dimension, the threads split the next ones
+	vector_n<float, 3> d(2, 300, 128);
+	for_each(d, [n = 0](float &x) mutable { x = float(n++ % 5); });
+	const vector_n<float, 2> first = d.reduce<1>(std::plus<>(), 1), split = d.reduce<1>(std::plus<>(), 4);
+	if (!std::equal(first.begin(), first.end(), split.begin())) return false;
+	vector_n<float, 3> e(vector_layout<3>({2, 1, 0}), 128, 300, 2);
+	for_each(e, [n = 0](float &x) mutable { x = float(n++ % 5); });
+	const vector_n<float, 2> columns = e.reduce<1>(std::plus<>(), 3);
+	for (int i0 = 0; i0 < 128; i0 += 11)
+	{
+		float s = 0;
+		for (int i1 = 0; i1 < 300; ++i1) s += e(i0, i1, 1);
+		if (columns(i0, 1) != s) return false;
+	}
+	return true;
+}
+
 int main()
 {
 	auto tests = {test_index_full_1, test_index_full_2,
 		test_index_partial1, test_index_partial2,
 		test_fix1, test_fix2, test_fix_full, 
-		test_copy_constructor, test_copy_assignment};
+		test_copy_constructor, test_copy_assignment,
+		test_move_constructor, test_move_assignment, test_swap,
+		test_aligned_rows, test_custom_allocator, test_slice,
+		test_parallel_for_each, test_for_each, test_permute,
+		test_expressions, test_reductions, test_fixed_extents,
+		test_mapped, test_npy, test_view,
+		test_element_iterator, test_indexer_ranges,
+		test_init_modes, test_layout, test_tiled, test_stencil,
+		test_instrumentation, test_sparse, test_chunked,
+		test_cow, test_fill_copy, test_reduce_axes};
 	for (auto test : tests)
 	{
 		if (!test())
@@ -380,10 +1622,6 @@ int main()
 		}
 	}
 	std::cout << "Ok\n";
-	// TODO: write simple tests
-	/*testVector4d();
-	testVector2d();
-	testVector3d();*/
 
 	return 0;
 }
\ No newline at end of file
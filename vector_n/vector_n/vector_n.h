@@ -5,10 +5,58 @@
 #include <array>
 #include <numeric>
 #include <cassert> 
+#include <utility>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <exception>
+#include <algorithm>
+#include <iterator>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "vector_n_simd.h"
+#include "vector_n_instrumentation.h"
 
 template <size_t N>
 using vector_size = std::array<size_t, N>;
 
+// Range [from, to) with step, like from:to:step in python.
+// Default constructed range selects the whole dimension
+struct vector_range
+{
+	vector_range() : from(0), to(size_t(-1)), step(1) {}
+	vector_range(size_t afrom, size_t ato, size_t astep = 1) : from(afrom), to(ato), step(astep) {}
+
+	size_t from;
+	size_t to;
+	size_t step;
+};
+
+// Operations for reduce<Axes...>, which are vectorised along the contiguous dimension like
+// std::plus<>. The first argument is the accumulated value, the same as in min_value and max_value
+struct reduce_min
+{
+	template<class T>
+	const T &operator()(const T &acc, const T &x) const { return x < acc ? x : acc; }
+};
+
+struct reduce_max
+{
+	template<class T>
+	const T &operator()(const T &acc, const T &x) const { return acc < x ? x : acc; }
+};
+
+template<typename ElementType, size_t numDims, class Allocator = std::allocator<ElementType>>
+class vector_n;
+
+template<class ElementType, size_t ... Extents>
+class vector_n_fixed_view;
+
 namespace impl
 {
 	template<typename Arg>
@@ -46,9 +94,7 @@ namespace impl
 	template<typename ...Args>
 	bool allPositive(Args ... args)
 	{
-		bool positive(true);
-		ignore(positive = positive && args >= 0 ...);
-		return positive;
+		return (true && ... && (args >= 0));
 	};
 
 	inline bool checkIndex(const size_t *){ return true; }
@@ -73,14 +119,35 @@ namespace impl
 		*arr = *(arr + 1) * second;
 	}
 
+	// innerStride is the (possibly padded) length of the innermost dimension
 	template <size_t N>
-	inline void calcCoefficients(size_t *arr, const size_t *args)
+	inline void calcCoefficients(size_t *arr, const size_t *args, size_t innerStride)
 	{
 		*(arr + N - 1) = 1;
 
-		for (int n = N - 2; n >= 0; --n)
+		for (int n = int(N) - 2; n >= 0; --n)
+		{
+			*(arr + n) = *(arr + n + 1) * (n == int(N) - 2 ? innerStride : *(args + n + 1));
+		}
+	}
+
+	template <size_t N>
+	inline void calcCoefficients(size_t *arr, const size_t *args)
+	{
+		calcCoefficients<N>(arr, args, *(args + N - 1));
+	}
+
+	// The same for the given order of the dimensions in memory (the last one is the innermost),
+	// innerStride is the length of order[N - 1]
+	template <size_t N>
+	inline void calcCoefficients(size_t *arr, const size_t *args, const std::array<int, N> &order, size_t innerStride)
+	{
+		arr[order[N - 1]] = 1;
+		size_t stride = innerStride;
+		for (int n = int(N) - 2; n >= 0; --n)
 		{
-			*(arr + n) = *(arr + n + 1) * *(args + n + 1);
+			arr[order[n]] = stride;
+			stride *= args[order[n]];
 		}
 	}
 
@@ -112,10 +179,10 @@ namespace impl
 
 	template<class ElementType, int numCoords> struct DerefIter<ElementType, numCoords, 0>
 	{
-		DerefIter(const std::array<size_t, numCoords> &i, const ElementType &v)
+		DerefIter(const std::array<size_t, numCoords> &i, ElementType &v)
 			: index(i), value(v) {}
 		const std::array<size_t, numCoords> &index;
-		const ElementType &value;
+		ElementType &value;
 	};
 
 	// STL compatible iterator
@@ -128,23 +195,23 @@ namespace impl
 		const static int numDimsSlice = numDimsSource - numCoords;
 	public:
 
+		// to is the position after the last one, step is signed (to < from if it's negative),
+		// positions are compared modulo 2^n, so to may be "-1"
 		template<int ...IS>
 		ElemIter(const std::array<size_t, numCoords> &from, 
 			const std::array<size_t, numCoords> &to,
 			const std::array<size_t, numCoords> &cur,
 			const std::array<size_t, numCoords> &coefs,
+			const std::array<ptrdiff_t, numCoords> &step,
 			SourceType &source,
 			std::integer_sequence<int, IS...>)
 			: m_from(from), m_to(to),
-			  m_current_pos(cur)
+			  m_current_pos(cur), m_delta(step)
 		{
 			static_assert(sizeof...(IS) == numCoords, "Number of indexes must be equal to numCoords");
 
 			for(int i = 0; i != numCoords; ++i)
 			{
-				if(from[i] < to[i]) m_delta[i] = 1;
-				else m_delta[i] = -1;
-
 				m_delta1[i] = coefs[i] * m_delta[i];
 				m_delta2[i] = (from[i] - to[i]) * coefs[i];
 			}
@@ -159,6 +226,7 @@ namespace impl
 		ThisType &operator++()
 		{
 			int i = numCoords - 1;
+			VECTOR_N_COUNT(T, numDimsSource, iterator_steps, 1);
 
 			while(i != -1)
 			{
@@ -168,6 +236,7 @@ namespace impl
 				{
 					m_current_pos[i] = m_from[i];
 					m_data.coefs[numDimsSlice] += m_delta2[i];
+					VECTOR_N_COUNT(T, numDimsSource, iterator_wraps, 1);
 
 					--i;
 				}
@@ -208,7 +277,7 @@ namespace impl
 		std::array<size_t, numCoords> m_from;
 		std::array<size_t, numCoords> m_to;
 		std::array<size_t, numCoords> m_current_pos;
-		std::array<signed char, numCoords> m_delta;
+		std::array<ptrdiff_t, numCoords> m_delta;
 
 		// Additional members, just for performance
 		VectorSlice<std::remove_const_t<T>, numDimsSlice> m_data;
@@ -239,6 +308,63 @@ namespace impl
 	template<class T, int N, int ...IS>
 	class Indexer;
 
+	template<class T, int N, int ...IS>
+	class ElementRange;
+
+	// Number of the threads to use, all available if numThreads is 0
+	inline unsigned thread_count(unsigned numThreads)
+	{
+#ifdef _OPENMP
+		if(numThreads == 0) numThreads = unsigned(omp_get_max_threads());
+#else
+		if(numThreads == 0) numThreads = std::thread::hardware_concurrency();
+#endif
+		return numThreads != 0 ? numThreads : 1;
+	}
+
+	// Splits [0, count) into contiguous chunks, one per thread, and calls f(begin, end) for each of them.
+	// Exception thrown by any chunk is rethrown in the calling thread
+	template<class Function>
+	void parallel_for_range(size_t count, unsigned numThreads, Function f)
+	{
+		numThreads = thread_count(numThreads);
+		if(numThreads > count) numThreads = unsigned(count);
+		if(numThreads <= 1)
+		{
+			if(count != 0) f(size_t(0), count);
+			return;
+		}
+
+		std::vector<std::exception_ptr> errors(numThreads);
+		auto chunk = [&](unsigned t)
+		{
+			try
+			{
+				f(count * t / numThreads, count * (t + 1) / numThreads);
+			}
+			catch(...)
+			{
+				errors[t] = std::current_exception();
+			}
+		};
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static, 1) num_threads(int(numThreads))
+		for(int t = 0; t < int(numThreads); ++t) chunk(unsigned(t));
+#else
+		std::vector<std::thread> threads;
+		threads.reserve(numThreads - 1);
+		for(unsigned t = 1; t != numThreads; ++t) threads.emplace_back(chunk, t);
+		chunk(0);
+		for(auto &thread : threads) thread.join();
+#endif
+
+		for(auto &error : errors)
+		{
+			if(error) std::rethrow_exception(error);
+		}
+	}
+
 	template <int V, int... Tail> constexpr bool has_v = false;
 	template <int V, int F, int... Tail>
 	constexpr bool has_v<V, F, Tail...> = (V == F) || has_v<V, Tail...>;
@@ -257,6 +383,205 @@ namespace impl
 
 	template<int N, int ...I> constexpr bool valid_index_set = min<I...> >= 0 && max<I...> < N && distinct<I...>;
 
+	// Loops over dimensions IS, the first one is the outermost
+	template<int First, int ...Rest>
+	struct NestedLoop
+	{
+		template<class T, size_t N, class Function>
+		static inline void run(T *ptr, const std::array<size_t, N> &sizes, 
+			const std::array<size_t, N> &strides, Function &f)
+		{
+			const size_t n = sizes[First], step = strides[First];
+			for(size_t i = 0; i != n; ++i, ptr += step)
+			{
+				NestedLoop<Rest...>::run(ptr, sizes, strides, f);
+			}
+		}
+	};
+
+	template<int Last>
+	struct NestedLoop<Last>
+	{
+		template<class T, size_t N, class Function>
+		static inline void run(T *ptr, const std::array<size_t, N> &sizes, 
+			const std::array<size_t, N> &strides, Function &f)
+		{
+			const size_t n = sizes[Last], step = strides[Last];
+			// Separate loop for the contiguous case, so it can be vectorized
+			if(step == 1)
+			{
+				for(size_t i = 0; i != n; ++i) f(ptr[i]);
+			}
+			else
+			{
+				for(size_t i = 0; i != n; ++i) f(ptr[i * step]);
+			}
+		}
+	};
+
+	template<class T, size_t N, class Function, int ...IS>
+	inline void for_each_impl(T *ptr, const std::array<size_t, N> &sizes,
+		const std::array<size_t, N> &strides, Function &f, std::integer_sequence<int, IS...>)
+	{
+		static_assert(sizeof...(IS) == N && valid_index_set<N, IS...>, "Index set must be a permutation");
+		NestedLoop<IS...>::run(ptr, sizes, strides, f);
+	}
+
+	// Copies the box of the given sizes in the order of the dimensions, dst[N - 1] is the innermost one
+	template<class T, size_t N>
+	void copy_block(T *dst, const std::array<size_t, N> &dstStrides,
+		const T *src, const std::array<size_t, N> &srcStrides, const std::array<size_t, N> &sizes, size_t dim = 0)
+	{
+		if(dim == N - 1)
+		{
+			for(size_t i = 0; i != sizes[dim]; ++i) dst[i * dstStrides[dim]] = src[i * srcStrides[dim]];
+			return;
+		}
+		for(size_t i = 0; i != sizes[dim]; ++i)
+		{
+			copy_block(dst + i * dstStrides[dim], dstStrides, src + i * srcStrides[dim], srcStrides, sizes, dim + 1);
+		}
+	}
+
+	// Cache-oblivious copy between different layouts: the largest dimension is split in halves
+	// until the box is small enough, so both source and destination lines stay in cache
+	template<class T, size_t N>
+	void copy_recursive(T *dst, const std::array<size_t, N> &dstStrides,
+		const T *src, const std::array<size_t, N> &srcStrides, const std::array<size_t, N> &sizes)
+	{
+		const size_t blockElements = 8192 / sizeof(T) + 1;
+
+		size_t volume = 1;
+		int largest = 0;
+		for(int i = 0; i != int(N); ++i)
+		{
+			volume *= sizes[i];
+			if(sizes[i] > sizes[largest]) largest = i;
+		}
+		if(volume == 0) return;
+		if(volume <= blockElements)
+		{
+			copy_block(dst, dstStrides, src, srcStrides, sizes);
+			return;
+		}
+
+		auto first = sizes;
+		first[largest] /= 2;
+		auto second = sizes;
+		second[largest] -= first[largest];
+
+		copy_recursive(dst, dstStrides, src, srcStrides, first);
+		copy_recursive(dst + first[largest] * dstStrides[largest], dstStrides,
+			src + first[largest] * srcStrides[largest], srcStrides, second);
+	}
+
+	// Dimensions of K operands with the same sizes, ordered by the strides of the first operand
+	// (the smallest one is the innermost) and merged where all operands are contiguous,
+	// so the runs along the innermost dimension are as long as possible
+	template<size_t N, size_t K>
+	struct Coalesced
+	{
+		Coalesced(const std::array<size_t, N> &asizes, const std::array<std::array<size_t, N>, K> &astrides)
+			: rank(0), count(1)
+		{
+			for(size_t size : asizes) count *= size;
+			if(count == 0) return;
+
+			// Dimensions of size 1 don't matter
+			std::array<int, N> order;
+			int n = 0;
+			for(int i = 0; i != int(N); ++i)
+			{
+				if(asizes[i] != 1) order[n++] = i;
+			}
+			for(int i = 1; i < n; ++i)
+			{
+				for(int j = i; j > 0 && astrides[0][order[j - 1]] < astrides[0][order[j]]; --j) std::swap(order[j - 1], order[j]);
+			}
+
+			// From the innermost dimension outwards
+			for(int i = n - 1; i >= 0; --i)
+			{
+				const int d = order[i];
+				bool merge = rank != 0;
+				for(size_t k = 0; merge && k != K; ++k) merge = astrides[k][d] == strides[k][rank - 1] * sizes[rank - 1];
+
+				if(merge)
+				{
+					sizes[rank - 1] *= asizes[d];
+					continue;
+				}
+				sizes[rank] = asizes[d];
+				for(size_t k = 0; k != K; ++k) strides[k][rank] = astrides[k][d];
+				++rank;
+			}
+
+			if(rank == 0)
+			{
+				rank = 1;
+				sizes[0] = 1;
+				for(size_t k = 0; k != K; ++k) strides[k][0] = 1;
+			}
+			std::reverse(sizes.begin(), sizes.begin() + rank);
+			for(size_t k = 0; k != K; ++k) std::reverse(strides[k].begin(), strides[k].begin() + rank);
+		}
+
+		// Calls f(offsets, length, innerStrides) for every run along the innermost dimension,
+		// offsets are in elements from the origins of the operands
+		template<class Function>
+		void for_each_run(Function f) const
+		{
+			if(count == 0) return;
+
+			const int inner = rank - 1;
+			std::array<size_t, N> pos{};
+			std::array<size_t, K> offsets{};
+			std::array<size_t, K> innerStrides;
+			for(size_t k = 0; k != K; ++k) innerStrides[k] = strides[k][inner];
+
+			while(true)
+			{
+				f(offsets, sizes[inner], innerStrides);
+
+				int i = inner - 1;
+				for(; i >= 0; --i)
+				{
+					for(size_t k = 0; k != K; ++k) offsets[k] += strides[k][i];
+					if(++pos[i] != sizes[i]) break;
+
+					for(size_t k = 0; k != K; ++k) offsets[k] -= strides[k][i] * sizes[i];
+					pos[i] = 0;
+				}
+				if(i < 0) return;
+			}
+		}
+
+		int rank;
+		size_t count;
+		std::array<size_t, N> sizes;
+		std::array<std::array<size_t, N>, K> strides;
+	};
+
+	// Visits the elements in the order of memory, the dimensions are sorted by the strides and merged
+	template<class T, size_t N, class Function>
+	inline void for_each_memory_order(T *ptr, const std::array<size_t, N> &sizes,
+		const std::array<size_t, N> &strides, Function &f)
+	{
+		const Coalesced<N, 1> shape(sizes, {strides});
+		shape.for_each_run([&](const std::array<size_t, 1> &offsets, size_t n, const std::array<size_t, 1> &step)
+		{
+			T *row = ptr + offsets[0];
+			if(step[0] == 1)
+			{
+				for(size_t i = 0; i != n; ++i) f(row[i]);
+			}
+			else
+			{
+				for(size_t i = 0; i != n; ++i) f(row[i * step[0]]);
+			}
+		});
+	}
+
 	template<int...Nums> bool has_v_fun(int a)
 	{
 		for(int x : {Nums...})
@@ -266,10 +591,60 @@ namespace impl
 		return false;
 	}
 
+	// Kind of the element type as in numpy: bool, float, signed, unsigned or raw bytes
+	template<class T>
+	constexpr char element_kind()
+	{
+		return std::is_same_v<T, bool> ? 'b' :
+			std::is_floating_point_v<T> ? 'f' :
+			std::is_integral_v<T> && std::is_signed_v<T> ? 'i' :
+			std::is_integral_v<T> ? 'u' : 'V';
+	}
+
+	// Base of all expression template nodes
+	struct ExprTag {};
+
+	template<class E>
+	constexpr bool is_expr = std::is_base_of_v<ExprTag, E>;
+
+	template<class T, int N, class E, class Assign>
+	void evaluate(const VectorSlice<T, N> &dst, const E &expr, Assign assign);
+
+	template<class T, int N>
+	void fill_slice(const VectorSlice<T, N> &dst, const T &value);
+
+	template<class T, class U, int N>
+	void copy_slice(const VectorSlice<T, N> &dst, const VectorSlice<U, N> &src);
+
+	template<class T, int N, class Op, int ...Axes>
+	vector_n<std::remove_const_t<T>, N - sizeof...(Axes)> reduce_axes(const VectorSlice<T, N> &src, Op op,
+		unsigned numThreads, std::integer_sequence<int, Axes...>);
+
+	template<class T, int N> class SliceExpr;
+	template<class T> class ScalarExpr;
+
+	template<ReduceOp Op, class T, class U, int N>
+	std::remove_const_t<T> reduce_all(const VectorSlice<T, N> &a, const VectorSlice<U, N> &b);
+
+	template<class T, int N>
+	SliceExpr<T, N> as_expr(const VectorSlice<T, N> &slice);
+
+	template<class E>
+	std::enable_if_t<is_expr<E>, E> as_expr(const E &expr);
+
+	template<class S>
+	std::enable_if_t<std::is_arithmetic_v<S>, ScalarExpr<S>> as_expr(const S &value);
+
+	// Ordinary operations of the compound assignment operators
+	struct AssignOp { template<class T, class V> void operator()(T &d, const V &v) const { d = v; } };
+	struct AddAssignOp { template<class T, class V> void operator()(T &d, const V &v) const { d += v; } };
+	struct SubAssignOp { template<class T, class V> void operator()(T &d, const V &v) const { d -= v; } };
+	struct MulAssignOp { template<class T, class V> void operator()(T &d, const V &v) const { d *= v; } };
+	struct DivAssignOp { template<class T, class V> void operator()(T &d, const V &v) const { d /= v; } };
 
 	template<class ElementType, int numDims> class VectorSlice {
 		
-		template<class ElementType, int numDims, int N>
+		template<class T, int numDimsSource, int numCoords>
 		friend class ElemIter;
 		
 		template<class T, int N>
@@ -278,8 +653,11 @@ namespace impl
 		template<class T, int N, int ... IS>
 		friend class Indexer;
 
+		template<class T, size_t ... E>
+		friend class ::vector_n_fixed_view;
+
 	public:
-		VectorSlice() : coefs{0}, sizes{0}
+		VectorSlice() : coefs{}, sizes{}, data(nullptr)
 		{
 		}
 
@@ -307,7 +685,11 @@ namespace impl
 			static_assert(impl::AllNumeric<Indexes...>::value, "Parameters type is invalid");
 			static_assert(sizeof...(indexes) == numDims, "Parameters count is invalid");
 
-			if(!impl::checkIndex(indexes...)) throw std::out_of_range("One or more indexes are invalid");
+			if(!impl::checkIndex(sizes.data(), indexes...))
+			{
+				VECTOR_N_COUNT(ElementType, numDims, bounds_failures, 1);
+				throw std::out_of_range("One or more indexes are invalid");
+			}
 
 			return data[getIndex(indexes ...)];
 		}
@@ -318,7 +700,11 @@ namespace impl
 			static_assert(impl::AllNumeric<Indexes...>::value, "Parameters type is invalid");
 			static_assert(sizeof...(indexes) == numDims, "Parameters count is invalid");
 
-			if(!impl::checkIndex(indexes...)) throw std::out_of_range("One or more indexes are invalid");
+			if(!impl::checkIndex(sizes.data(), indexes...))
+			{
+				VECTOR_N_COUNT(ElementType, numDims, bounds_failures, 1);
+				throw std::out_of_range("One or more indexes are invalid");
+			}
 
 			return data[getIndex(indexes ...)];
 		}
@@ -333,6 +719,18 @@ namespace impl
 			return Indexer<const ElementType, numDims, IS...>(*this);
 		}
 
+		// Random-access range over all elements, IS is the order of the dimensions
+		// (the first one is the outermost), the natural order if empty
+		template<int ...IS> ElementRange<ElementType, numDims, IS...> elements()
+		{
+			return ElementRange<ElementType, numDims, IS...>(origin(), sizes, strides());
+		}
+
+		template<int ...IS> ElementRange<const ElementType, numDims, IS...> elements() const
+		{
+			return ElementRange<const ElementType, numDims, IS...>(origin(), sizes, strides());
+		}
+
 		inline size_t size(const int numberDims) const
 		{
 			assert((numberDims - 1) <= numDims && (numberDims - 1) >= 0 && "Parameters count is invalid");
@@ -345,6 +743,20 @@ namespace impl
 			return sizes;
 		}
 
+		// Distance in elements between neighbours along each dimension
+		inline vector_size<numDims> strides() const
+		{
+			vector_size<numDims> res;
+			for(int i = 0; i != numDims; ++i) res[i] = coefs[i];
+			return res;
+		}
+
+		// Pointer to the element with zero indexes
+		inline ElementType *origin() const
+		{
+			return data + coefs[numDims];
+		}
+
 		template<int...Indexes, class ...Args>
 		VectorSlice<ElementType, numDims - sizeof...(Indexes)> fix(Args ...c_index)
 		{
@@ -371,10 +783,15 @@ namespace impl
 			}
 			for(size_t i = 0; i != sizeof...(Indexes); ++i)
 			{
-				if(args[i] >= sizes[template_index[i]]) throw std::invalid_argument("One or more index too large");
+				if(args[i] >= sizes[template_index[i]])
+				{
+					VECTOR_N_COUNT(ElementType, numDims, bounds_failures, 1);
+					throw std::invalid_argument("One or more index too large");
+				}
 				new_coefs[new_dim] += coefs[template_index[i]] * args[i];
 			}
 
+			VECTOR_N_COUNT(ElementType, numDims, slices, 1);
 			VectorSlice<ElementType, new_dim> res;
 			res.reset(new_coefs, new_sizes, data);
 			return res;
@@ -407,15 +824,200 @@ namespace impl
 			}
 			for (size_t i = 0; i != sizeof...(Indexes); ++i)
 			{
-				if (args[i] >= sizes[template_index[i]]) throw std::invalid_argument("One or more index too large");
+				if (args[i] >= sizes[template_index[i]])
+				{
+					VECTOR_N_COUNT(ElementType, numDims, bounds_failures, 1);
+					throw std::invalid_argument("One or more index too large");
+				}
 				new_coefs[new_dim] += coefs[template_index[i]] * args[i];
 			}
 
+			VECTOR_N_COUNT(ElementType, numDims, slices, 1);
 			VectorSlice<ElementType, new_dim> res;
 			res.reset(new_coefs, new_sizes, data);
 			return res;
 		}
 
+		// View of the same rank, which contains only elements of the given ranges.
+		// For example a.slice({{10, 50}, {}, {0, 100, 2}}) is a[10:50, :, 0:100:2]
+		VectorSlice<ElementType, numDims> slice(const vector_range (&ranges)[numDims]) const
+		{
+			std::array<size_t, numDims + 1> new_coefs = coefs;
+			std::array<size_t, numDims> new_sizes;
+
+			for(int i = 0; i != numDims; ++i)
+			{
+				const vector_range &r = ranges[i];
+				const size_t to = r.to < sizes[i] ? r.to : sizes[i];
+				if(r.step == 0) throw std::invalid_argument("Step must be positive");
+				if(r.from > to) throw std::invalid_argument("One or more ranges are invalid");
+
+				new_sizes[i] = (to - r.from + r.step - 1) / r.step;
+				new_coefs[i] = coefs[i] * r.step;
+				new_coefs[numDims] += coefs[i] * r.from;
+			}
+
+			VECTOR_N_COUNT(ElementType, numDims, slices, 1);
+			VectorSlice<ElementType, numDims> res;
+			res.reset(new_coefs, new_sizes, data);
+			return res;
+		}
+
+		// Reductions over all elements. Contiguous runs of float and double use SIMD kernels with
+		// several accumulators, so the result may differ from the sequential sum in the last bits
+		std::remove_const_t<ElementType> sum() const
+		{
+			return reduce_all<ReduceOp::sum>(*this, *this);
+		}
+
+		// NaN elements are skipped, the result is NaN only if the first element in memory is NaN
+		std::remove_const_t<ElementType> min_value() const
+		{
+			return reduce_all<ReduceOp::min>(*this, *this);
+		}
+
+		std::remove_const_t<ElementType> max_value() const
+		{
+			return reduce_all<ReduceOp::max>(*this, *this);
+		}
+
+		template<class T>
+		std::remove_const_t<ElementType> dot(const VectorSlice<T, numDims> &other) const
+		{
+			static_assert(std::is_same_v<std::remove_const_t<T>, std::remove_const_t<ElementType>>, "Element types differ");
+			if(other.sizes != sizes) throw std::invalid_argument("Sizes of the operands differ");
+
+			return reduce_all<ReduceOp::dot>(*this, other);
+		}
+
+		// Folds the elements along the dimensions Axes by op(accumulated, element), the result has
+		// the other dimensions in the same order. For example a.reduce<3>(std::plus<>()) sums
+		// a 4D array over the last axis. The loops go along the contiguous dimension, the kept
+		// dimensions are split between numThreads threads (all available if 0) for large arrays.
+		// std::plus<>, reduce_min and reduce_max are vectorised when the contiguous dimension is reduced
+		template<int ...Axes, class Op>
+		vector_n<std::remove_const_t<ElementType>, numDims - sizeof...(Axes)> reduce(Op op, unsigned numThreads = 0) const
+		{
+			return reduce_axes(*this, op, numThreads, std::integer_sequence<int, Axes...>());
+		}
+
+		// Mean along the dimensions Axes (integer division for the integer types)
+		template<int ...Axes>
+		vector_n<std::remove_const_t<ElementType>, numDims - sizeof...(Axes)> mean(unsigned numThreads = 0) const
+		{
+			auto res = reduce<Axes...>(std::plus<>(), numThreads);
+			size_t count = 1;
+			for(int axis : {Axes...}) count *= sizes[axis];
+			typedef std::remove_const_t<ElementType> V;
+			auto divide = [count](V &x) { x /= V(count); };
+			for_each_memory_order(res.origin(), res.size(), res.strides(), divide);
+			return res;
+		}
+
+		// Euclidean norm
+		auto norm() const
+		{
+			using std::sqrt;
+			return sqrt(reduce_all<ReduceOp::dot>(*this, *this));
+		}
+
+		// View where dimension i is dimension IS[i] of this slice. Nothing is copied,
+		// so permuted_view<2, 0, 1>() visits elements in the order of get_indexer<2, 0, 1>()
+		template<int ...IS>
+		VectorSlice<ElementType, numDims> permuted_view() const
+		{
+			static_assert(sizeof...(IS) == numDims && valid_index_set<numDims, IS...>, "Index set must be a permutation");
+
+			VECTOR_N_COUNT(ElementType, numDims, slices, 1);
+			VectorSlice<ElementType, numDims> res;
+			res.reset({coefs[IS]..., coefs[numDims]}, {sizes[IS]...}, data);
+			return res;
+		}
+
+		// Copy of permuted_view<IS...>() with the natural layout
+		template<int ...IS>
+		vector_n<std::remove_const_t<ElementType>, numDims> permute() const
+		{
+			const auto view = permuted_view<IS...>();
+
+			vector_n<std::remove_const_t<ElementType>, numDims> res;
+			res.resize(view.sizes);
+			copy_recursive(res.origin(), res.strides(), 
+				static_cast<const ElementType*>(view.origin()), view.strides(), view.sizes);
+			return res;
+		}
+
+		// Sets every element to value. The dimensions which are contiguous together are merged,
+		// so a dense slice is filled by one memset or std::fill
+		void fill(const std::remove_const_t<ElementType> &value)
+		{
+			fill_slice(*this, value);
+		}
+
+		// Element-wise copy of another slice of the same sizes, the slices must not overlap.
+		// The dimensions contiguous in both slices are merged, the contiguous runs of the same
+		// trivially copyable type are copied by memmove
+		template<class T>
+		void copy_from(const VectorSlice<T, numDims> &src)
+		{
+			copy_slice(*this, src);
+		}
+
+		// Element-wise assignment of a slice (copy_from), a value (fill) or an expression
+		template<class T>
+		void assign(const VectorSlice<T, numDims> &src)
+		{
+			copy_slice(*this, src);
+		}
+
+		void assign(const std::remove_const_t<ElementType> &value)
+		{
+			fill_slice(*this, value);
+		}
+
+		template<class E, class = std::enable_if_t<is_expr<E>>>
+		void assign(const E &expr)
+		{
+			evaluate(*this, expr, AssignOp());
+		}
+
+		// Element-wise assignment of the expression, see operators below.
+		// Note that the assignment of another VectorSlice rebinds the view instead
+		template<class E, class = std::enable_if_t<is_expr<E>>>
+		VectorSlice &operator=(const E &expr)
+		{
+			evaluate(*this, expr, AssignOp());
+			return *this;
+		}
+
+		template<class E>
+		VectorSlice &operator+=(const E &expr)
+		{
+			evaluate(*this, as_expr(expr), AddAssignOp());
+			return *this;
+		}
+
+		template<class E>
+		VectorSlice &operator-=(const E &expr)
+		{
+			evaluate(*this, as_expr(expr), SubAssignOp());
+			return *this;
+		}
+
+		template<class E>
+		VectorSlice &operator*=(const E &expr)
+		{
+			evaluate(*this, as_expr(expr), MulAssignOp());
+			return *this;
+		}
+
+		template<class E>
+		VectorSlice &operator/=(const E &expr)
+		{
+			evaluate(*this, as_expr(expr), DivAssignOp());
+			return *this;
+		}
+
 	protected:
 		void reset(const std::array<size_t, numDims + 1> &acoefs,
 			const std::array<size_t, numDims> &asizes, ElementType *adata)
@@ -430,6 +1032,13 @@ namespace impl
 			data = ptr;
 		}
 
+		void swap(VectorSlice &other) noexcept
+		{
+			std::swap(coefs, other.coefs);
+			std::swap(sizes, other.sizes);
+			std::swap(data, other.data);
+		}
+
 	private:
 		std::array<size_t, numDims + 1> coefs;
 		std::array<size_t, numDims> sizes;
@@ -462,112 +1071,1221 @@ namespace impl
 		{
 			from.fill(0);
 			to = m_source.size();
+			steps.fill(1);
+			reversed.fill(false);
 		}
 
 		IteratorType begin()
 		{
-			IteratorType it({from[IS]...}, {m_source.size()[IS]...}, // From and to
-				{from[IS]...}, // current position
-				{m_source.coefs[IS]...},
-				m_source, std::integer_sequence<int, IS...>());
-			return it;
+			if(count() == 0) return end();
+			return make_iterator(first());
 		}
 
 		IteratorType end()
 		{
-			IteratorType it({from[IS]...}, {m_source.size()[IS]...}, // From and to
-				{to[IS]...}, // current position
-				{m_source.coefs[IS]...},
-				m_source, std::integer_sequence<int, IS...>());
-			return it;
+			return make_iterator(last());
 		}
 
-		Indexer &rev(int) {return *this;}
-	private:
-		SourceType &m_source;
+		// Number of positions visited by the iteration
+		size_t count() const
+		{
+			size_t res = 1;
+			for(size_t extent : {extent(IS)...}) res *= extent;
+			return res;
+		}
 
-		std::array<size_t, N> from;
-		std::array<size_t, N> to;
+		// Iterator which points to the n-th position of the iteration, n <= count()
+		IteratorType iterator_at(size_t n)
+		{
+			if(n >= count()) return end();
 
-		static_assert(valid_index_set<N, IS...>, "Index set must be a permutation");
-	};
-}
+			std::array<size_t, sizeof...(IS)> extents{extent(IS)...};
+			std::array<size_t, sizeof...(IS)> cur = first();
+			std::array<ptrdiff_t, sizeof...(IS)> delta{delta_of(IS)...};
+			for(int i = int(sizeof...(IS)) - 1; i >= 0; --i)
+			{
+				cur[i] += (n % extents[i]) * delta[i];
+				n /= extents[i];
+			}
+			return make_iterator(cur);
+		}
 
-template<typename ElementType, size_t numDims>
-class vector_n : public impl::VectorSlice<ElementType, numDims>
-{
-	typedef impl::VectorSlice<ElementType, numDims> Base;
+		// Iterates only [first, last) along the dimension
+		Indexer &range(int dim, size_t first, size_t last)
+		{
+			check_dim(dim);
+			if(first > last || last > m_source.size()[dim]) throw std::out_of_range("Range is invalid");
+			from[dim] = first;
+			to[dim] = last;
+			return *this;
+		}
+
+		// Iterates the dimension from the end to the beginning
+		Indexer &rev(int dim)
+		{
+			check_dim(dim);
+			reversed[dim] = !reversed[dim];
+			return *this;
+		}
+
+		// Visits every step-th position of the dimension, starting from the first one of the range
+		// (the last one if reversed)
+		Indexer &step(int dim, size_t step)
+		{
+			check_dim(dim);
+			if(step == 0) throw std::invalid_argument("Step must be positive");
+			steps[dim] = step;
+			return *this;
+		}
+
+	private:
+		SourceType &m_source;
+
+		// Range [from, to) of every dimension, the step and the direction
+		std::array<size_t, N> from;
+		std::array<size_t, N> to;
+		std::array<size_t, N> steps;
+		std::array<bool, N> reversed;
+
+		void check_dim(int dim) const
+		{
+			if(!has_v_fun<IS...>(dim)) throw std::invalid_argument("Dimension isn't iterated by the indexer");
+		}
+
+		size_t extent(int dim) const
+		{
+			return to[dim] > from[dim] ? (to[dim] - from[dim] + steps[dim] - 1) / steps[dim] : 0;
+		}
+
+		ptrdiff_t delta_of(int dim) const
+		{
+			return reversed[dim] ? -ptrdiff_t(steps[dim]) : ptrdiff_t(steps[dim]);
+		}
+
+		size_t start(int dim) const
+		{
+			return reversed[dim] && extent(dim) != 0 ? from[dim] + (extent(dim) - 1) * steps[dim] : from[dim];
+		}
+
+		std::array<size_t, sizeof...(IS)> first() const
+		{
+			return {start(IS)...};
+		}
+
+		// Position after the last one along every dimension
+		std::array<size_t, sizeof...(IS)> last() const
+		{
+			return {(start(IS) + extent(IS) * delta_of(IS))...};
+		}
+
+		IteratorType make_iterator(const std::array<size_t, sizeof...(IS)> &cur)
+		{
+			return IteratorType(first(), last(), cur,
+				{m_source.coefs[IS]...}, {delta_of(IS)...},
+				m_source, std::integer_sequence<int, IS...>());
+		}
+
+		static_assert(valid_index_set<N, IS...>, "Index set must be a permutation");
+	};
+
+	// Random-access iterator over the elements of a slice in the given order of the dimensions.
+	// It keeps the pointer to the current element, so the moves within the innermost dimension
+	// are just pointer increments, and the jumps decode the position in O(N)
+	template<class T, int N>
+	class ElementIterator
+	{
+	public:
+		typedef std::random_access_iterator_tag iterator_category;
+		typedef std::remove_const_t<T> value_type;
+		typedef ptrdiff_t difference_type;
+		typedef T *pointer;
+		typedef T &reference;
+
+		ElementIterator() {}
+
+		// sizes, strides and order are in the order of the iteration
+		ElementIterator(T *origin, const std::array<size_t, N> &sizes, const std::array<size_t, N> &strides,
+			const std::array<int, N> &order, size_t index)
+			: m_origin(origin), m_sizes(sizes), m_strides(strides), m_order(order)
+		{
+			seek(index);
+		}
+
+		reference operator*() const { return *m_ptr; }
+		pointer operator->() const { return m_ptr; }
+		reference operator[](difference_type n) const { return *(*this + n); }
+
+		ElementIterator &operator++()
+		{
+			VECTOR_N_COUNT(T, N, iterator_steps, 1);
+			if(++m_index == m_rowEnd)
+			{
+				VECTOR_N_COUNT(T, N, iterator_wraps, 1);
+				seek(m_index);
+			}
+			else m_ptr += m_strides[N - 1];
+			return *this;
+		}
+
+		ElementIterator &operator--()
+		{
+			if(m_index == m_rowEnd - m_sizes[N - 1]) seek(m_index - 1);
+			else
+			{
+				--m_index;
+				m_ptr -= m_strides[N - 1];
+			}
+			return *this;
+		}
+
+		ElementIterator operator++(int) { auto res = *this; ++*this; return res; }
+		ElementIterator operator--(int) { auto res = *this; --*this; return res; }
+
+		ElementIterator &operator+=(difference_type n) { seek(size_t(difference_type(m_index) + n)); return *this; }
+		ElementIterator &operator-=(difference_type n) { seek(size_t(difference_type(m_index) - n)); return *this; }
+
+		friend ElementIterator operator+(ElementIterator it, difference_type n) { return it += n; }
+		friend ElementIterator operator+(difference_type n, ElementIterator it) { return it += n; }
+		friend ElementIterator operator-(ElementIterator it, difference_type n) { return it -= n; }
+
+		friend difference_type operator-(const ElementIterator &a, const ElementIterator &b)
+		{
+			return difference_type(a.m_index) - difference_type(b.m_index);
+		}
+
+		friend bool operator==(const ElementIterator &a, const ElementIterator &b) { return a.m_index == b.m_index; }
+		friend bool operator!=(const ElementIterator &a, const ElementIterator &b) { return a.m_index != b.m_index; }
+		friend bool operator<(const ElementIterator &a, const ElementIterator &b) { return a.m_index < b.m_index; }
+		friend bool operator>(const ElementIterator &a, const ElementIterator &b) { return a.m_index > b.m_index; }
+		friend bool operator<=(const ElementIterator &a, const ElementIterator &b) { return a.m_index <= b.m_index; }
+		friend bool operator>=(const ElementIterator &a, const ElementIterator &b) { return a.m_index >= b.m_index; }
+
+		// Number of the position in the iteration
+		size_t index() const { return m_index; }
+
+		// Indexes of the current element in the dimensions of the slice
+		std::array<size_t, N> position() const
+		{
+			std::array<size_t, N> res;
+			size_t n = m_index;
+			for(int i = N - 1; i >= 0; --i)
+			{
+				res[m_order[i]] = n % m_sizes[i];
+				n /= m_sizes[i];
+			}
+			return res;
+		}
+
+	private:
+		T *m_origin = nullptr;
+		T *m_ptr = nullptr;
+		size_t m_index = 0;
+		// Index where the current row of the innermost dimension ends
+		size_t m_rowEnd = 0;
+		std::array<size_t, N> m_sizes{};
+		std::array<size_t, N> m_strides{};
+		std::array<int, N> m_order{};
+
+		void seek(size_t index)
+		{
+			m_index = index;
+			const size_t inner = m_sizes[N - 1];
+			if(inner == 0) return;
+			m_rowEnd = (index / inner + 1) * inner;
+
+			size_t offset = 0, n = index;
+			for(int i = N - 1; i > 0; --i)
+			{
+				offset += n % m_sizes[i] * m_strides[i];
+				n /= m_sizes[i];
+			}
+			// Past-the-end position has the first index equal to its size
+			m_ptr = m_origin + offset + n * m_strides[0];
+		}
+	};
+
+	// Empty order means the natural one
+	template<int N, int ...I> constexpr bool valid_order = sizeof...(I) == N && valid_index_set<N, I...>;
+	template<int N> constexpr bool valid_order<N> = true;
+
+	template<class T, int N, int ...IS>
+	class ElementRange
+	{
+		static_assert(valid_order<N, IS...>, "Index set must be a permutation");
+	public:
+		typedef ElementIterator<T, N> iterator;
+
+		ElementRange(T *origin, const std::array<size_t, N> &sizes, const std::array<size_t, N> &strides)
+			: m_origin(origin), m_count(1)
+		{
+			std::array<int, N> order;
+			if constexpr(sizeof...(IS) == 0) std::iota(order.begin(), order.end(), 0);
+			else order = {IS...};
+
+			for(int i = 0; i != N; ++i)
+			{
+				m_order[i] = order[i];
+				m_sizes[i] = sizes[order[i]];
+				m_strides[i] = strides[order[i]];
+				m_count *= m_sizes[i];
+			}
+		}
+
+		iterator begin() const { return iterator(m_origin, m_sizes, m_strides, m_order, 0); }
+		iterator end() const { return iterator(m_origin, m_sizes, m_strides, m_order, m_count); }
+		size_t size() const { return m_count; }
+
+	private:
+		T *m_origin;
+		size_t m_count;
+		std::array<size_t, N> m_sizes;
+		std::array<size_t, N> m_strides;
+		std::array<int, N> m_order;
+	};
+
+	// Expression templates. Operators build a tree of nodes, which is evaluated in one pass
+	// on assignment. Every node has
+	//   dims - rank of the expression, 0 for scalars
+	//   shape() - sizes of the expression, nullptr for scalars
+	//   contiguous(sizes, strides) - true if all slices of the expression have these strides
+	//   flat() - cursor over the memory of the destination, only if contiguous() and it's dense
+	//   row(pos, dim) - cursor along the dimension dim starting at pos (pos[dim] is 0)
+	// Cursors are indexed by the position in the row (or in the whole array for flat())
+
+	template<size_t N>
+	inline bool is_dense(const std::array<size_t, N> &sizes, const std::array<size_t, N> &strides)
+	{
+		size_t expected = 1;
+		for(int i = int(N) - 1; i >= 0; --i)
+		{
+			if(sizes[i] != 1 && strides[i] != expected) return false;
+			expected *= sizes[i];
+		}
+		return true;
+	}
+
+	// Dense in some order of the dimensions, so the elements occupy [origin, origin + count)
+	template<size_t N>
+	inline bool is_dense_any(const std::array<size_t, N> &sizes, const std::array<size_t, N> &strides)
+	{
+		const Coalesced<N, 1> shape(sizes, {strides});
+		return shape.count != 0 && shape.rank == 1 && shape.strides[0][0] == 1;
+	}
+
+	// Strides of the dimensions of size 1 don't matter
+	template<size_t N>
+	inline bool same_strides(const std::array<size_t, N> &sizes, const std::array<size_t, N> &a, const std::array<size_t, N> &b)
+	{
+		for(size_t i = 0; i != N; ++i)
+		{
+			if(sizes[i] != 1 && a[i] != b[i]) return false;
+		}
+		return true;
+	}
+
+	// Scalars have no shape, so they match any other one
+	template<class S> inline bool same_shape(const S *l, const S *r) { return *l == *r; }
+	inline bool same_shape(const void *, const void *) { return true; }
+
+	template<class S> inline const S *select_shape(const S *l, const void *) { return l; }
+	template<class S> inline const S *select_shape(const void *, const S *r) { return r; }
+	template<class S> inline const S *select_shape(const S *l, const S *) { return l; }
+
+	template<class T, int N>
+	class SliceExpr : public ExprTag
+	{
+	public:
+		typedef std::remove_const_t<T> value_type;
+		static const int dims = N;
+
+		explicit SliceExpr(const VectorSlice<T, N> &slice)
+			: m_origin(slice.origin()), m_sizes(slice.size()), m_strides(slice.strides())
+		{
+		}
+
+		const vector_size<N> *shape() const { return &m_sizes; }
+		bool contiguous(const vector_size<N> &strides) const { return same_strides(m_sizes, m_strides, strides); }
+
+		struct FlatCursor
+		{
+			const value_type *ptr;
+			value_type operator[](size_t i) const { return ptr[i]; }
+		};
+
+		struct RowCursor
+		{
+			const value_type *ptr;
+			size_t stride;
+			value_type operator[](size_t i) const { return ptr[i * stride]; }
+		};
+
+		FlatCursor flat() const { return {m_origin}; }
+
+		RowCursor row(const size_t *pos, int dim) const
+		{
+			const value_type *ptr = m_origin;
+			for(int i = 0; i < N; ++i) ptr += pos[i] * m_strides[i];
+			return {ptr, m_strides[dim]};
+		}
+
+	private:
+		const value_type *m_origin;
+		vector_size<N> m_sizes;
+		vector_size<N> m_strides;
+	};
+
+	template<class T>
+	class ScalarExpr : public ExprTag
+	{
+	public:
+		typedef T value_type;
+		static const int dims = 0;
+
+		explicit ScalarExpr(const T &value) : m_value(value) {}
+
+		const void *shape() const { return nullptr; }
+		template<class S> bool contiguous(const S &) const { return true; }
+
+		struct Cursor
+		{
+			T value;
+			const T &operator[](size_t) const { return value; }
+		};
+
+		Cursor flat() const { return {m_value}; }
+		Cursor row(const size_t *, int) const { return {m_value}; }
+
+	private:
+		T m_value;
+	};
+
+	template<class Function, class A>
+	class UnaryExpr : public ExprTag
+	{
+	public:
+		typedef decltype(std::declval<const Function&>()(std::declval<typename A::value_type>())) value_type;
+		static const int dims = A::dims;
+
+		UnaryExpr(const A &a, const Function &f) : m_a(a), m_f(f) {}
+
+		auto shape() const { return m_a.shape(); }
+		template<class S> bool contiguous(const S &strides) const { return m_a.contiguous(strides); }
+
+		template<class C> struct Cursor
+		{
+			C a;
+			const Function *f;
+			value_type operator[](size_t i) const { return (*f)(a[i]); }
+		};
+
+		auto flat() const { return Cursor<decltype(m_a.flat())>{m_a.flat(), &m_f}; }
+		auto row(const size_t *pos, int dim) const { return Cursor<decltype(m_a.row(pos, dim))>{m_a.row(pos, dim), &m_f}; }
+
+	private:
+		A m_a;
+		Function m_f;
+	};
+
+	template<class Op, class L, class R>
+	class BinaryExpr : public ExprTag
+	{
+		static_assert(L::dims == R::dims || L::dims == 0 || R::dims == 0, "Ranks of the operands differ");
+	public:
+		typedef decltype(Op()(std::declval<typename L::value_type>(), std::declval<typename R::value_type>())) value_type;
+		static const int dims = L::dims > R::dims ? L::dims : R::dims;
+
+		BinaryExpr(const L &l, const R &r) : m_l(l), m_r(r)
+		{
+			if(!same_shape(l.shape(), r.shape())) throw std::invalid_argument("Sizes of the operands differ");
+		}
+
+		auto shape() const { return select_shape(m_l.shape(), m_r.shape()); }
+		template<class S> bool contiguous(const S &strides) const { return m_l.contiguous(strides) && m_r.contiguous(strides); }
+
+		template<class LC, class RC> struct Cursor
+		{
+			LC l;
+			RC r;
+			value_type operator[](size_t i) const { return Op()(l[i], r[i]); }
+		};
+
+		auto flat() const 
+		{
+			return Cursor<decltype(m_l.flat()), decltype(m_r.flat())>{m_l.flat(), m_r.flat()};
+		}
+
+		auto row(const size_t *pos, int dim) const
+		{
+			return Cursor<decltype(m_l.row(pos, dim)), decltype(m_r.row(pos, dim))>{m_l.row(pos, dim), m_r.row(pos, dim)};
+		}
+
+	private:
+		L m_l;
+		R m_r;
+	};
+
+	template<class T, int N>
+	std::true_type slice_test(const VectorSlice<T, N> *);
+	std::false_type slice_test(...);
+
+	template<class X>
+	constexpr bool is_slice = decltype(slice_test(std::declval<X*>()))::value;
+
+	// Types which can be operands of the expressions
+	template<class X>
+	constexpr bool is_operand = is_expr<X> || is_slice<X> || std::is_arithmetic_v<X>;
+
+	template<class L, class R>
+	constexpr bool is_operand_pair = is_operand<L> && is_operand<R> && 
+		!(std::is_arithmetic_v<L> && std::is_arithmetic_v<R>);
+
+	template<class T, int N>
+	inline SliceExpr<T, N> as_expr(const VectorSlice<T, N> &slice)
+	{
+		return SliceExpr<T, N>(slice);
+	}
+
+	template<class E>
+	inline std::enable_if_t<is_expr<E>, E> as_expr(const E &expr)
+	{
+		return expr;
+	}
+
+	template<class S>
+	inline std::enable_if_t<std::is_arithmetic_v<S>, ScalarExpr<S>> as_expr(const S &value)
+	{
+		return ScalarExpr<S>(value);
+	}
+
+	template<class Op, class L, class R>
+	inline auto make_binary(const L &l, const R &r)
+	{
+		typedef decltype(as_expr(l)) LE;
+		typedef decltype(as_expr(r)) RE;
+		return BinaryExpr<Op, LE, RE>(as_expr(l), as_expr(r));
+	}
+
+	template<class L, class R, class = std::enable_if_t<is_operand_pair<L, R>>>
+	inline auto operator+(const L &l, const R &r) { return make_binary<std::plus<>>(l, r); }
+
+	template<class L, class R, class = std::enable_if_t<is_operand_pair<L, R>>>
+	inline auto operator-(const L &l, const R &r) { return make_binary<std::minus<>>(l, r); }
+
+	template<class L, class R, class = std::enable_if_t<is_operand_pair<L, R>>>
+	inline auto operator*(const L &l, const R &r) { return make_binary<std::multiplies<>>(l, r); }
+
+	template<class L, class R, class = std::enable_if_t<is_operand_pair<L, R>>>
+	inline auto operator/(const L &l, const R &r) { return make_binary<std::divides<>>(l, r); }
+
+	template<class A, class = std::enable_if_t<is_expr<A> || is_slice<A>>>
+	inline auto operator-(const A &a)
+	{
+		typedef decltype(as_expr(a)) AE;
+		return UnaryExpr<std::negate<>, AE>(as_expr(a), std::negate<>());
+	}
+
+	template<ReduceOp Op, class T, class U, int N>
+	std::remove_const_t<T> reduce_all(const VectorSlice<T, N> &a, const VectorSlice<U, N> &b)
+	{
+		typedef std::remove_const_t<T> V;
+		const V *pa = a.origin();
+		const V *pb = b.origin();
+
+		const Coalesced<N, 2> shape(a.size(), {a.strides(), b.strides()});
+		if(shape.count == 0)
+		{
+			if(Op == ReduceOp::min || Op == ReduceOp::max) throw std::invalid_argument("Slice is empty");
+			return V();
+		}
+
+		V res = reduce_init<Op>(pa);
+		shape.for_each_run([&](const std::array<size_t, 2> &offsets, size_t n, const std::array<size_t, 2> &strides)
+		{
+			const V run = strides[0] == 1 && strides[1] == 1 ?
+				reduce_contiguous<Op>(pa + offsets[0], pb + offsets[1], n) :
+				reduce_strided<Op>(pa + offsets[0], strides[0], pb + offsets[1], strides[1], n);
+			reduce_step<Op == ReduceOp::dot ? ReduceOp::sum : Op>(res, run, run);
+		});
+		return res;
+	}
+
+	// Lazy application of f to every element of the operand
+	template<class A, class Function, class = std::enable_if_t<is_expr<A> || is_slice<A>>>
+	inline auto elementwise(const A &a, Function f)
+	{
+		typedef decltype(as_expr(a)) AE;
+		return UnaryExpr<Function, AE>(as_expr(a), f);
+	}
+
+	// Writes the expression into dst, assign(dst_element, value) is called for every element.
+	// The expression must not read elements of dst other than the one being written
+	template<class T, int N, class E, class Assign>
+	void evaluate(const VectorSlice<T, N> &dst, const E &expr, Assign assign)
+	{
+		static_assert(E::dims == N || E::dims == 0, "Ranks of the operands differ");
+		const vector_size<N> &sizes = dst.size();
+		const vector_size<N> strides = dst.strides();
+		T *out = dst.origin();
+
+		if(!same_shape(&sizes, expr.shape())) throw std::invalid_argument("Sizes of the operands differ");
+
+		size_t count = 1;
+		for(size_t size : sizes) count *= size;
+		if(count == 0) return;
+
+		// Fast path, everything is one contiguous block with the same layout
+		if(is_dense_any(sizes, strides) && expr.contiguous(strides))
+		{
+			auto cursor = expr.flat();
+			for(size_t i = 0; i != count; ++i) assign(out[i], cursor[i]);
+			return;
+		}
+
+		// The innermost loop goes along the dimension with the smallest stride of dst,
+		// the outer ones in the order of the decreasing strides
+		std::array<int, N> order;
+		std::iota(order.begin(), order.end(), 0);
+		auto key = [&](int d) { return sizes[d] == 1 ? size_t(-1) : strides[d]; };
+		for(int i = 1; i < N; ++i)
+		{
+			for(int j = i; j > 0 && key(order[j - 1]) < key(order[j]); --j) std::swap(order[j - 1], order[j]);
+		}
+
+		const int inner = order[N - 1];
+		const size_t rowSize = sizes[inner];
+		const size_t rows = count / rowSize;
+		const size_t step = strides[inner];
+
+		std::array<size_t, N> pos{};
+		for(size_t r = 0; r != rows; ++r)
+		{
+			T *ptr = out;
+			for(int i = 0; i < N; ++i) ptr += pos[i] * strides[i];
+
+			auto cursor = expr.row(pos.data(), inner);
+			for(size_t i = 0; i != rowSize; ++i) assign(ptr[i * step], cursor[i]);
+
+			for(int i = N - 2; i >= 0; --i)
+			{
+				if(++pos[order[i]] != sizes[order[i]]) break;
+				pos[order[i]] = 0;
+			}
+		}
+	}
+}
+
+namespace impl
+{
+	template<class T, int N>
+	void fill_slice(const VectorSlice<T, N> &dst, const T &value)
+	{
+		static_assert(!std::is_const_v<T>, "Destination must be writable");
+		T *out = dst.origin();
+
+		// memset works for the single bytes and for the values which are all zero bytes
+		bool bytes = false;
+		if constexpr(std::is_trivially_copyable_v<T>)
+		{
+			const unsigned char zero[sizeof(T)] = {};
+			bytes = sizeof(T) == 1 || std::memcmp(&value, zero, sizeof(T)) == 0;
+		}
+
+		const Coalesced<N, 1> shape(dst.size(), {dst.strides()});
+		shape.for_each_run([&](const std::array<size_t, 1> &offsets, size_t n, const std::array<size_t, 1> &strides)
+		{
+			T *ptr = out + offsets[0];
+			if(strides[0] != 1)
+			{
+				for(size_t i = 0; i != n; ++i) ptr[i * strides[0]] = value;
+			}
+			else if(bytes)
+			{
+				unsigned char byte;
+				std::memcpy(&byte, &value, 1);
+				std::memset(static_cast<void*>(ptr), byte, n * sizeof(T));
+			}
+			else std::fill_n(ptr, n, value);
+		});
+	}
+
+	template<class T, class U, int N>
+	void copy_slice(const VectorSlice<T, N> &dst, const VectorSlice<U, N> &src)
+	{
+		static_assert(!std::is_const_v<T>, "Destination must be writable");
+		typedef std::remove_const_t<U> V;
+		if(dst.size() != src.size()) throw std::invalid_argument("Sizes of the operands differ");
+
+		T *out = dst.origin();
+		const V *in = src.origin();
+		const Coalesced<N, 2> shape(dst.size(), {dst.strides(), src.strides()});
+		shape.for_each_run([&](const std::array<size_t, 2> &offsets, size_t n, const std::array<size_t, 2> &strides)
+		{
+			T *to = out + offsets[0];
+			const V *from = in + offsets[1];
+			if(strides[0] == 1 && strides[1] == 1)
+			{
+				if constexpr(std::is_same_v<T, V> && std::is_trivially_copyable_v<T>) std::memmove(static_cast<void*>(to), from, n * sizeof(T));
+				else for(size_t i = 0; i != n; ++i) to[i] = T(from[i]);
+			}
+			else
+			{
+				for(size_t i = 0; i != n; ++i) to[i * strides[0]] = T(from[i * strides[1]]);
+			}
+		});
+	}
+
+	// Operations of reduce_axes over the arithmetic types, which have the kernels of reduce_contiguous
+	template<class Op, class V>
+	struct VectorisedReduce : std::false_type {};
+
+	template<class V>
+	struct VectorisedReduce<std::plus<>, V> : std::is_arithmetic<V> { static constexpr ReduceOp op = ReduceOp::sum; };
+
+	template<class V>
+	struct VectorisedReduce<std::plus<V>, V> : std::is_arithmetic<V> { static constexpr ReduceOp op = ReduceOp::sum; };
+
+	template<class V>
+	struct VectorisedReduce<reduce_min, V> : std::is_arithmetic<V> { static constexpr ReduceOp op = ReduceOp::min; };
+
+	template<class V>
+	struct VectorisedReduce<reduce_max, V> : std::is_arithmetic<V> { static constexpr ReduceOp op = ReduceOp::max; };
+
+	// Arrays smaller than this are reduced by one thread
+	constexpr size_t reduceParallelMin = size_t(1) << 16;
+
+	template<class T, int N, class Op, int ...Axes>
+	vector_n<std::remove_const_t<T>, N - sizeof...(Axes)> reduce_axes(const VectorSlice<T, N> &src, Op op,
+		unsigned numThreads, std::integer_sequence<int, Axes...>)
+	{
+		constexpr int K = int(sizeof...(Axes));
+		constexpr int M = N - K;
+		static_assert(K > 0 && K < N, "Reduce all dimensions with sum, min_value, max_value");
+		static_assert(valid_index_set<N, Axes...>, "Invalid index set");
+		typedef std::remove_const_t<T> V;
+
+		const vector_size<N> &sizes = src.size();
+		const vector_size<N> strides = src.strides();
+		const V *in = src.origin();
+
+		// The kept dimensions and the reduced ones
+		std::array<size_t, M> keptSizes, keptStrides;
+		std::array<size_t, K> redSizes, redStrides;
+		size_t redCount = 1;
+		for(int d = 0, m = 0, k = 0; d != N; ++d)
+		{
+			if(has_v_fun<Axes...>(d))
+			{
+				redSizes[k] = sizes[d];
+				redStrides[k++] = strides[d];
+				redCount *= sizes[d];
+			}
+			else
+			{
+				keptSizes[m] = sizes[d];
+				keptStrides[m++] = strides[d];
+			}
+		}
+		if(redCount == 0) throw std::invalid_argument("Slice is empty");
+
+		vector_n<V, M> res;
+		res.resize(keptSizes);
+		V *out = res.origin();
+		const std::array<size_t, M> resStrides = res.strides();
+		size_t keptCount = 1;
+		for(size_t n : keptSizes) keptCount *= n;
+		if(keptCount == 0) return res;
+		if(keptCount * redCount < reduceParallelMin) numThreads = 1;
+
+		// Dimension with the smallest stride, which isn't of size 1
+		int inner = -1;
+		for(int d = 0; d != N; ++d)
+		{
+			if(sizes[d] != 1 && (inner == -1 || strides[d] < strides[inner])) inner = d;
+		}
+
+		if(inner == -1 || !has_v_fun<Axes...>(inner))
+		{
+			// The contiguous dimension is kept: the slices along the reduced dimensions are
+			// accumulated into the result element-wise. The threads take ranges of the kept elements
+			// in the order of memory, split over the outer kept dimensions, so that every thread gets work
+			std::array<int, M> order;
+			for(int m = 0; m != M; ++m)
+			{
+				order[m] = m;
+				for(int j = m; j > 0 && keptStrides[order[j - 1]] < keptStrides[order[j]]; --j) std::swap(order[j - 1], order[j]);
+			}
+
+			const size_t threads = numThreads == 1 ? 1 : thread_count(numThreads);
+			int outer = 0;
+			size_t outerCount = 1;
+			while(outer != M && (outer == 0 || outerCount < threads)) outerCount *= keptSizes[order[outer++]];
+			const int last = order[outer - 1];
+
+			// Accumulates the box of the kept dimensions, which starts at the given offsets
+			auto accumulate = [&](const std::array<size_t, M> &box, size_t inOffset, size_t outOffset)
+			{
+				// Ordered by the strides of the source
+				const Coalesced<M, 2> shape(box, {keptStrides, resStrides});
+				V *dst = out + outOffset;
+
+				std::array<size_t, K> pos{};
+				size_t offset = inOffset;
+				for(size_t r = 0; r != redCount; ++r)
+				{
+					const V *from = in + offset;
+					shape.for_each_run([&](const std::array<size_t, 2> &offsets, size_t n, const std::array<size_t, 2> &step)
+					{
+						const V *b = from + offsets[0];
+						V *a = dst + offsets[1];
+						if(r == 0)
+						{
+							for(size_t i = 0; i != n; ++i) a[i * step[1]] = b[i * step[0]];
+						}
+						else if(step[0] == 1 && step[1] == 1)
+						{
+							for(size_t i = 0; i != n; ++i) a[i] = op(a[i], b[i]);
+						}
+						else
+						{
+							for(size_t i = 0; i != n; ++i) a[i * step[1]] = op(a[i * step[1]], b[i * step[0]]);
+						}
+					});
+
+					for(int k = K - 1; k >= 0; --k)
+					{
+						offset += redStrides[k];
+						if(++pos[k] != redSizes[k]) break;
+						offset -= redStrides[k] * redSizes[k];
+						pos[k] = 0;
+					}
+				}
+			};
+
+			parallel_for_range(outerCount, numThreads, [&](size_t begin, size_t end)
+			{
+				// The range is cut into boxes, where only the last outer dimension is partial
+				for(size_t e = begin; e != end;)
+				{
+					const size_t j = e % keptSizes[last], n = std::min(keptSizes[last] - j, end - e);
+					std::array<size_t, M> box = keptSizes;
+					box[last] = n;
+					size_t inOffset = j * keptStrides[last], outOffset = j * resStrides[last];
+					size_t index = e / keptSizes[last];
+					for(int o = outer - 2; o >= 0; --o)
+					{
+						const int d = order[o];
+						inOffset += index % keptSizes[d] * keptStrides[d];
+						outOffset += index % keptSizes[d] * resStrides[d];
+						index /= keptSizes[d];
+						box[d] = 1;
+					}
+					accumulate(box, inOffset, outOffset);
+					e += n;
+				}
+			});
+		}
+		else
+		{
+			// The contiguous dimension is reduced: every element of the result folds
+			// the reduced box in the order of memory. Contiguous runs of the operations,
+			// which reduce_contiguous implements, go through the vectorised kernels
+			const Coalesced<K, 1> shape(redSizes, {redStrides});
+			parallel_for_range(keptCount, numThreads, [&](size_t begin, size_t end)
+			{
+				for(size_t e = begin; e != end; ++e)
+				{
+					const V *base = in;
+					size_t index = e;
+					for(int m = M - 1; m >= 0; --m)
+					{
+						base += index % keptSizes[m] * keptStrides[m];
+						index /= keptSizes[m];
+					}
+
+					V acc = *base;
+					bool first = true;
+					shape.for_each_run([&](const std::array<size_t, 1> &offsets, size_t n, const std::array<size_t, 1> &step)
+					{
+						const V *run = base + offsets[0];
+						if constexpr (VectorisedReduce<Op, V>::value)
+						{
+							if(step[0] == 1)
+							{
+								const V part = reduce_contiguous<VectorisedReduce<Op, V>::op>(run, run, n);
+								acc = first ? part : op(acc, part);
+								first = false;
+								return;
+							}
+						}
+						for(size_t i = first ? 1 : 0; i != n; ++i) acc = op(acc, run[i * step[0]]);
+						first = false;
+					});
+					out[e] = acc;
+				}
+			});
+		}
+		return res;
+	}
+}
+
+// Allocator adaptor, which makes vector::resize(n) leave the elements of the trivially
+// default constructible types uninitialized, other types are value-initialized as usual.
+// vector_n<T, N, default_init_allocator<A>> skips the serial zeroing of the new elements,
+// so vector_n_init::none leaves them uninitialized and vector_n_init::first_touch writes them
+// in parallel. getData() of such array behaves in the same way
+template<class Allocator>
+class default_init_allocator : public Allocator
+{
+	typedef std::allocator_traits<Allocator> Traits;
+public:
+	template<class U> struct rebind
+	{
+		typedef default_init_allocator<typename Traits::template rebind_alloc<U>> other;
+	};
+
+	default_init_allocator() = default;
+
+	default_init_allocator(const Allocator &alloc) noexcept
+		: Allocator(alloc)
+	{
+	}
+
+	template<class Other>
+	default_init_allocator(const default_init_allocator<Other> &other) noexcept
+		: Allocator(static_cast<const Other&>(other))
+	{
+	}
+
+	template<class U>
+	void construct(U *ptr) noexcept(std::is_nothrow_default_constructible_v<U>)
+	{
+		if constexpr(std::is_trivially_default_constructible_v<U>) ::new(static_cast<void*>(ptr)) U;
+		else ::new(static_cast<void*>(ptr)) U();
+	}
+
+	template<class U, class ... Args>
+	void construct(U *ptr, Args && ... args)
+	{
+		Traits::construct(static_cast<Allocator&>(*this), ptr, std::forward<Args>(args)...);
+	}
+};
+
+namespace impl
+{
+	template<class Allocator>
+	struct is_default_init_allocator : std::false_type {};
+
+	template<class Allocator>
+	struct is_default_init_allocator<default_init_allocator<Allocator>> : std::true_type {};
+}
+
+// Allocator which returns memory aligned to Alignment bytes (cache line by default)
+template<class T, size_t Alignment = 64>
+class aligned_allocator
+{
+	static_assert(Alignment >= alignof(T), "Alignment is less than the alignment of the type");
+	static_assert((Alignment & (Alignment - 1)) == 0, "Alignment must be a power of two");
+public:
+	typedef T value_type;
+
+	template<class U> struct rebind
+	{
+		typedef aligned_allocator<U, Alignment> other;
+	};
+
+	aligned_allocator() noexcept {}
+
+	template<class U>
+	aligned_allocator(const aligned_allocator<U, Alignment> &) noexcept {}
+
+	T *allocate(size_t n)
+	{
+		if(n > size_t(-1) / sizeof(T)) throw std::bad_array_new_length();
+		return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+	}
+
+	void deallocate(T *ptr, size_t) noexcept
+	{
+		::operator delete(ptr, std::align_val_t(Alignment));
+	}
+
+	template<class U>
+	bool operator==(const aligned_allocator<U, Alignment> &) const noexcept
+	{
+		return true;
+	}
+
+	template<class U>
+	bool operator!=(const aligned_allocator<U, Alignment> &) const noexcept
+	{
+		return false;
+	}
+};
+
+// Pads the innermost dimension so that every row starts at a multiple of bytes.
+// The buffer itself must be aligned too, e.g. by aligned_allocator
+struct vector_row_alignment
+{
+	explicit vector_row_alignment(size_t abytes) : bytes(abytes) {}
+	size_t bytes;
+};
+
+// Order of the dimensions in memory, the first one is the outermost and the last one is contiguous.
+// Indexes are always given in the logical order, only the strides depend on the layout
+template<size_t N>
+struct vector_layout
+{
+	vector_layout()
+	{
+		std::iota(order.begin(), order.end(), 0);
+	}
+
+	explicit vector_layout(const std::array<int, N> &aorder)
+		: order(aorder)
+	{
+		std::array<int, N> sorted = order;
+		std::sort(sorted.begin(), sorted.end());
+		for(int i = 0; i != int(N); ++i)
+		{
+			if(sorted[i] != i) throw std::invalid_argument("Layout must be a permutation of the dimensions");
+		}
+	}
+
+	static vector_layout row_major()
+	{
+		return vector_layout();
+	}
+
+	// As in Fortran and BLAS, the first index is contiguous
+	static vector_layout column_major()
+	{
+		vector_layout res;
+		std::reverse(res.order.begin(), res.order.end());
+		return res;
+	}
+
+	bool operator==(const vector_layout &other) const { return order == other.order; }
+	bool operator!=(const vector_layout &other) const { return order != other.order; }
+
+	std::array<int, N> order;
+};
+
+// How the sizing constructors and resize initialize the new elements. none and first_touch
+// take effect only with default_init_allocator, other allocators value-initialize the elements
+// in std::vector::resize
+enum class vector_n_init
+{
+	// Value-initialization (zeros for the arithmetic types)
+	value,
+	// Default-initialization, the elements of the trivial types are left uninitialized
+	none,
+	// Value-initialization split between the threads in the same way as parallel_for_each splits
+	// the natural order, so the pages are placed on the NUMA nodes of the threads which use them.
+	// The types which aren't trivially default constructible are constructed serially
+	first_touch
+};
+
+template<typename ElementType, size_t numDims, class Allocator>
+class vector_n : public impl::VectorSlice<ElementType, numDims>
+{
+	typedef impl::VectorSlice<ElementType, numDims> Base;
+	typedef std::vector<ElementType, Allocator> Storage;
 public:
 	vector_n() 
 	{
 		// Do something
 	}
 
+	explicit vector_n(const Allocator &alloc)
+		: data(alloc)
+	{
+	}
+
 	vector_n(const vector_n &other)
-		: Base(other), data(other.data)
+		: Base(other), data(other.data), rowAlignment(other.rowAlignment), initMode(other.initMode), 
+		  memoryLayout(other.memoryLayout)
+	{
+		Base::set_buf(data.data());
+		VECTOR_N_COUNT(ElementType, numDims, copies, 1);
+		VECTOR_N_COUNT(ElementType, numDims, copied_bytes, data.size() * sizeof(ElementType));
+		countAllocation(0);
+	}
+
+	// The buffer is taken over, so no allocation or element copy happens
+	vector_n(vector_n &&other) noexcept
+		: Base(other), data(std::move(other.data)), rowAlignment(other.rowAlignment), initMode(other.initMode),
+		  memoryLayout(other.memoryLayout)
 	{
 		Base::set_buf(data.data());
+		other.Base::reset({}, {}, nullptr);
 	}
 
 	template<typename ... Sizes>
 	vector_n(Sizes ... sizes)
-		: data(impl::product(sizes ...))
 	{
 		static_assert(sizeof...(sizes) == numDims, "Parameters count is invalid");
 		static_assert(impl::AllNumeric<Sizes...>::value, "Parameters type is invalid");
 
 		if(!impl::allPositive(sizes ...)) throw std::invalid_argument("All dimensions must be positive");
 
-		std::array<size_t, numDims + 1> coefs;
-		coefs[numDims] = 0;
+		resize(vector_size<numDims>{size_t(sizes)...});
+	}
+
+	// The elements are allocated by the copy of alloc
+	template<typename ... Sizes>
+	vector_n(const Allocator &alloc, Sizes ... sizes)
+		: data(alloc)
+	{
+		static_assert(sizeof...(sizes) == numDims, "Parameters count is invalid");
+		static_assert(impl::AllNumeric<Sizes...>::value, "Parameters type is invalid");
+
+		if(!impl::allPositive(sizes ...)) throw std::invalid_argument("All dimensions must be positive");
+
+		resize(vector_size<numDims>{size_t(sizes)...});
+	}
+
+	template<typename ... Sizes>
+	vector_n(vector_row_alignment alignment, Sizes ... sizes)
+		: rowAlignment(alignment.bytes)
+	{
+		static_assert(sizeof...(sizes) == numDims, "Parameters count is invalid");
+		static_assert(impl::AllNumeric<Sizes...>::value, "Parameters type is invalid");
+
+		if(!impl::allPositive(sizes ...)) throw std::invalid_argument("All dimensions must be positive");
+		if(rowAlignment != 0 && (rowAlignment & (rowAlignment - 1)) != 0)
+			throw std::invalid_argument("Row alignment must be a power of two");
 
-		impl::calcCoefficients(coefs.data(), sizes ...);
-		impl::VectorSlice<ElementType, numDims>::reset(coefs, {size_t(sizes)...}, data.data());
+		resize(vector_size<numDims>{size_t(sizes)...});
+	}
+
+	// The mode is also used by the following calls of resize
+	template<typename ... Sizes>
+	vector_n(vector_n_init init, Sizes ... sizes)
+		: initMode(init)
+	{
+		static_assert(sizeof...(sizes) == numDims, "Parameters count is invalid");
+		static_assert(impl::AllNumeric<Sizes...>::value, "Parameters type is invalid");
+
+		if(!impl::allPositive(sizes ...)) throw std::invalid_argument("All dimensions must be positive");
+
+		resize(vector_size<numDims>{size_t(sizes)...});
+	}
+
+	template<typename ... Sizes>
+	vector_n(vector_row_alignment alignment, vector_n_init init, Sizes ... sizes)
+		: rowAlignment(alignment.bytes), initMode(init)
+	{
+		static_assert(sizeof...(sizes) == numDims, "Parameters count is invalid");
+		static_assert(impl::AllNumeric<Sizes...>::value, "Parameters type is invalid");
+
+		if(!impl::allPositive(sizes ...)) throw std::invalid_argument("All dimensions must be positive");
+		if(rowAlignment != 0 && (rowAlignment & (rowAlignment - 1)) != 0)
+			throw std::invalid_argument("Row alignment must be a power of two");
+
+		resize(vector_size<numDims>{size_t(sizes)...});
+	}
+
+	// The layout is also used by the following calls of resize
+	template<typename ... Sizes>
+	vector_n(const vector_layout<numDims> &layout, Sizes ... sizes)
+		: vector_n(layout, vector_row_alignment(0), vector_n_init::value, sizes...)
+	{
+	}
+
+	// The padding goes to the dimension which is contiguous in memory
+	template<typename ... Sizes>
+	vector_n(const vector_layout<numDims> &layout, vector_row_alignment alignment, Sizes ... sizes)
+		: vector_n(layout, alignment, vector_n_init::value, sizes...)
+	{
+	}
+
+	template<typename ... Sizes>
+	vector_n(const vector_layout<numDims> &layout, vector_n_init init, Sizes ... sizes)
+		: vector_n(layout, vector_row_alignment(0), init, sizes...)
+	{
+	}
+
+	template<typename ... Sizes>
+	vector_n(const vector_layout<numDims> &layout, vector_row_alignment alignment, vector_n_init init, Sizes ... sizes)
+		: rowAlignment(alignment.bytes), initMode(init), memoryLayout(layout)
+	{
+		static_assert(sizeof...(sizes) == numDims, "Parameters count is invalid");
+		static_assert(impl::AllNumeric<Sizes...>::value, "Parameters type is invalid");
+
+		if(!impl::allPositive(sizes ...)) throw std::invalid_argument("All dimensions must be positive");
+		if(rowAlignment != 0 && (rowAlignment & (rowAlignment - 1)) != 0)
+			throw std::invalid_argument("Row alignment must be a power of two");
+
+		resize(vector_size<numDims>{size_t(sizes)...});
 	}
 
 	inline void resize(const vector_size <numDims> &sizesDims)
 	{
-		data.resize(std::accumulate(sizesDims.begin(), sizesDims.end(), 1, std::multiplies<size_t>()));
-		std::array<size_t, numDims> sizes = sizesDims;
 		std::array<size_t, numDims + 1> coefs;
 		coefs[numDims] = 0;
 
-		impl::calcCoefficients<numDims>(coefs.data(), sizesDims.data());
-		reset(coefs, sizes, data.data());
+		const std::array<int, numDims> &order = memoryLayout.order;
+		impl::calcCoefficients<numDims>(coefs.data(), sizesDims.data(), order, paddedExtent(sizesDims[order[numDims - 1]]));
+		// Rows in memory go along the innermost dimension of the layout
+		const size_t count = sizesDims[order[0]] * coefs[order[0]];
+		grow(count, numDims > 1 ? coefs[order[numDims > 1 ? numDims - 2 : 0]] : count);
+		Base::reset(coefs, sizesDims, data.data());
 	}
 
 	template<typename ... Sizes>
 	inline void resize(Sizes ... sizesDims)
 	{
-		resize({sizesDims...});
+		resize(vector_size<numDims>{size_t(sizesDims)...});
 	}
 
 	inline void clear()
 	{
-		std::vector<ElementType>().swap(data);
+		Storage(data.get_allocator()).swap(data);
+	}
+
+	// Alignment of the rows in bytes, 0 if the rows aren't padded
+	inline size_t row_alignment() const
+	{
+		return rowAlignment;
+	}
+
+	inline vector_n_init init_mode() const
+	{
+		return initMode;
+	}
+
+	inline const vector_layout<numDims> &layout() const
+	{
+		return memoryLayout;
 	}
 
-	typename std::vector<ElementType>::iterator begin()
+	Allocator get_allocator() const
+	{
+		return data.get_allocator();
+	}
+
+	// Note that padding elements of the rows are also included in this range
+	typename Storage::iterator begin()
 	{
 		return data.begin();
 	}
 
-	typename std::vector<ElementType>::iterator end()
+	typename Storage::iterator end()
 	{
 		return data.end();
 	}
 
-	typename std::vector<ElementType>::const_iterator begin() const
+	typename Storage::const_iterator begin() const
 	{
 		return data.begin();
 	}
 
-	typename std::vector<ElementType>::const_iterator end() const
+	typename Storage::const_iterator end() const
 	{
 		return data.end();
 	}
 
-	inline std::vector<ElementType>& getData()
+	inline Storage& getData()
 	{
 		return data;
 	}
@@ -578,11 +2296,25 @@ public:
 		return impl::checkIndex(Base::sizes.data(), indexes...);
 	}
 
+	template<class E, class = std::enable_if_t<impl::is_expr<E>>>
+	vector_n &operator=(const E &expr)
+	{
+		Base::operator=(expr);
+		return *this;
+	}
+
 	vector_n &operator=(const vector_n &other)
 	{
 		if(&other != this)
 		{
+			const size_t oldCapacity = data.capacity();
 			data = other.data;
+			VECTOR_N_COUNT(ElementType, numDims, copies, 1);
+			VECTOR_N_COUNT(ElementType, numDims, copied_bytes, data.size() * sizeof(ElementType));
+			countAllocation(oldCapacity);
+			rowAlignment = other.rowAlignment;
+			initMode = other.initMode;
+			memoryLayout = other.memoryLayout;
 			// Simple assignment for the base class
 			*static_cast<Base*>(this) = static_cast<const Base&>(other);
 
@@ -592,7 +2324,178 @@ public:
 		return *this;
 	}
 
+	vector_n &operator=(vector_n &&other) 
+		noexcept(std::allocator_traits<Allocator>::propagate_on_container_move_assignment::value ||
+			std::allocator_traits<Allocator>::is_always_equal::value)
+	{
+		if(&other != this)
+		{
+			data = std::move(other.data);
+			rowAlignment = other.rowAlignment;
+			initMode = other.initMode;
+			memoryLayout = other.memoryLayout;
+			*static_cast<Base*>(this) = static_cast<const Base&>(other);
+			Base::set_buf(data.data());
+
+			other.Base::reset({}, {}, nullptr);
+			other.data.clear();
+		}
+		return *this;
+	}
+
+	void swap(vector_n &other) noexcept
+	{
+		data.swap(other.data);
+		std::swap(rowAlignment, other.rowAlignment);
+		std::swap(initMode, other.initMode);
+		std::swap(memoryLayout, other.memoryLayout);
+		Base::swap(other);
+	}
+
 private:
 
-	std::vector<ElementType> data;
+	Storage data;
+	size_t rowAlignment = 0;
+	vector_n_init initMode = vector_n_init::value;
+	vector_layout<numDims> memoryLayout;
+
+	// Elements initialized by one thread at least with vector_n_init::first_touch
+	static constexpr size_t firstTouchChunk = size_t(1) << 16;
+
+	// Resizes the storage, new elements are initialized according to initMode.
+	// rowLength is the distance between the rows in memory, including the padding
+	void grow(size_t count, size_t rowLength)
+	{
+		const size_t oldCount = data.size(), oldCapacity = data.capacity();
+		// Only default_init_allocator leaves the trivial types uninitialized here
+		data.resize(count);
+		countAllocation(oldCapacity);
+		if(!impl::is_default_init_allocator<Allocator>::value || !std::is_trivially_default_constructible_v<ElementType> ||
+			initMode == vector_n_init::none || count <= oldCount)
+			return;
+
+		ElementType *ptr = data.data();
+		if(initMode == vector_n_init::first_touch)
+		{
+			// Whole rows go to the threads like parallel_for_each splits the natural order,
+			// small arrays aren't worth starting the threads
+			rowLength = std::max<size_t>(rowLength, 1);
+			const size_t rows = (count + rowLength - 1) / rowLength;
+			const size_t chunks = std::max<size_t>((count - oldCount) / firstTouchChunk, 1);
+			const unsigned numThreads = unsigned(std::min<size_t>(impl::thread_count(0), chunks));
+			impl::parallel_for_range(rows, numThreads, [=](size_t begin, size_t end)
+			{
+				const size_t from = std::max(begin * rowLength, oldCount), to = std::min(end * rowLength, count);
+				if(from < to) std::uninitialized_value_construct(ptr + from, ptr + to);
+			});
+		}
+		else std::uninitialized_value_construct(ptr + oldCount, ptr + count);
+	}
+
+	void countAllocation(size_t oldCapacity) const
+	{
+		if(data.capacity() != oldCapacity)
+		{
+			VECTOR_N_COUNT(ElementType, numDims, allocations, 1);
+			VECTOR_N_COUNT(ElementType, numDims, allocated_bytes, data.capacity() * sizeof(ElementType));
+		}
+		(void)oldCapacity;
+	}
+
+	// Length of the innermost dimension (in memory) including the padding
+	size_t paddedExtent(size_t extent) const
+	{
+		if(rowAlignment == 0) return extent;
+
+		const size_t step = std::lcm(rowAlignment, sizeof(ElementType)) / sizeof(ElementType);
+		return (extent + step - 1) / step * step;
+	}
 };
+
+template<typename ElementType, size_t numDims, class Allocator>
+inline void swap(vector_n<ElementType, numDims, Allocator> &a, vector_n<ElementType, numDims, Allocator> &b) noexcept
+{
+	a.swap(b);
+}
+
+// Non-owning view over memory of someone else (a C array, a receive buffer and so on).
+// The memory must outlive the view and all slices made from it
+template<typename ElementType, size_t numDims>
+class vector_n_view : public impl::VectorSlice<ElementType, numDims>
+{
+	typedef impl::VectorSlice<ElementType, numDims> Base;
+public:
+	vector_n_view()
+	{
+	}
+
+	vector_n_view(const Base &slice) : Base(slice)
+	{
+	}
+
+	// Elements are stored in the natural (row-major) order without gaps
+	vector_n_view(ElementType *ptr, const vector_size<numDims> &sizes)
+	{
+		std::array<size_t, numDims + 1> coefs;
+		coefs[numDims] = 0;
+		impl::calcCoefficients<numDims>(coefs.data(), sizes.data());
+		Base::reset(coefs, sizes, ptr);
+	}
+
+	// Strides are distances in elements between neighbours along each dimension
+	vector_n_view(ElementType *ptr, const vector_size<numDims> &sizes, const vector_size<numDims> &strides)
+	{
+		std::array<size_t, numDims + 1> coefs;
+		std::copy(strides.begin(), strides.end(), coefs.begin());
+		coefs[numDims] = 0;
+		Base::reset(coefs, sizes, ptr);
+	}
+
+	template<typename ... Sizes, class = std::enable_if_t<impl::AllNumeric<Sizes...>::value>>
+	vector_n_view(ElementType *ptr, Sizes ... sizes)
+		: vector_n_view(ptr, vector_size<numDims>{size_t(sizes)...})
+	{
+		static_assert(sizeof...(sizes) == numDims, "Parameters count is invalid");
+	}
+
+	// Points the view to another buffer with the same layout
+	void rebind(ElementType *ptr)
+	{
+		Base::set_buf(ptr);
+	}
+};
+
+// Calls f for every position of the indexer like the range-based for loop does, but
+// the iteration is split into contiguous parts which are processed by numThreads threads
+// (all available if 0). f must be safe to call concurrently for different positions
+template<class T, int N, int ...IS, class Function>
+void parallel_for_each(impl::Indexer<T, N, IS...> indexer, Function f, unsigned numThreads = 0)
+{
+	impl::parallel_for_range(indexer.count(), numThreads, [&](size_t begin, size_t end)
+	{
+		auto it = indexer.iterator_at(begin);
+		for(size_t i = begin; i != end; ++i, ++it)
+		{
+			f(*it);
+		}
+	});
+}
+
+// Calls f for every element of the slice. Dimensions are traversed in the order IS
+// (the last one is the innermost) like get_indexer<IS...>() does. Without IS the elements
+// are visited in the order of memory whatever the layout is (the natural order for row-major).
+// Loops are generated at compile time, so it works as fast as raw pointers
+template<int ...IS, class ElementType, int numDims, class Function>
+void for_each(impl::VectorSlice<ElementType, numDims> &slice, Function f)
+{
+	if constexpr(sizeof...(IS) == 0) impl::for_each_memory_order(slice.origin(), slice.size(), slice.strides(), f);
+	else impl::for_each_impl(slice.origin(), slice.size(), slice.strides(), f, std::integer_sequence<int, IS...>());
+}
+
+template<int ...IS, class ElementType, int numDims, class Function>
+void for_each(const impl::VectorSlice<ElementType, numDims> &slice, Function f)
+{
+	const ElementType *origin = slice.origin();
+	if constexpr(sizeof...(IS) == 0) impl::for_each_memory_order(origin, slice.size(), slice.strides(), f);
+	else impl::for_each_impl(origin, slice.size(), slice.strides(), f, std::integer_sequence<int, IS...>());
+}
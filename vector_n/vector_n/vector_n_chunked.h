@@ -0,0 +1,307 @@
+#pragma once
+#include "vector_n.h"
+#include "vector_n_sparse.h"
+
+// Default size of a slab of vector_n_chunked in bytes
+constexpr size_t vector_n_slab_bytes = size_t(64) << 20;
+
+namespace impl
+{
+	// The array split along the outermost dimension into slabs of rows outer indexes, every slab
+	// is allocated separately on the first write, the missing ones read as value-initialized
+	template<class T, size_t N>
+	class ChunkedSlabs
+	{
+	public:
+		static constexpr int rank = int(N);
+
+		ChunkedSlabs() : sizes{}, coefs{}, background()
+		{
+		}
+
+		ChunkedSlabs(const ChunkedSlabs &other)
+			: sizes(other.sizes), coefs(other.coefs), rows(other.rows), slabs(other.slabs.size()),
+			  committed(other.committed), background(other.background)
+		{
+			for(size_t i = 0; i != slabs.size(); ++i)
+			{
+				if(!other.slabs[i]) continue;
+				slabs[i].reset(new T[slabVolume(i)]);
+				std::copy(other.slabs[i].get(), other.slabs[i].get() + slabVolume(i), slabs[i].get());
+			}
+		}
+
+		ChunkedSlabs(ChunkedSlabs &&other) noexcept
+			: sizes(other.sizes), coefs(other.coefs), rows(other.rows), slabs(std::move(other.slabs)),
+			  committed(other.committed), background()
+		{
+			other.sizes = {};
+			other.committed = 0;
+		}
+
+		ChunkedSlabs &operator=(ChunkedSlabs other) noexcept
+		{
+			swap(other);
+			return *this;
+		}
+
+		void swap(ChunkedSlabs &other) noexcept
+		{
+			std::swap(sizes, other.sizes);
+			std::swap(coefs, other.coefs);
+			std::swap(rows, other.rows);
+			slabs.swap(other.slabs);
+			std::swap(committed, other.committed);
+		}
+
+		// All slabs are released
+		void resize(const std::array<size_t, N> &asizes, size_t slabRows)
+		{
+			sizes = asizes;
+			coefs[N - 1] = 1;
+			for(size_t i = N - 1; i-- > 0;) coefs[i] = coefs[i + 1] * sizes[i + 1];
+			rows = std::max<size_t>(slabRows, 1);
+			std::vector<std::unique_ptr<T[]>>((sizes[0] + rows - 1) / rows).swap(slabs);
+			committed = 0;
+		}
+
+		// The element for writing, its slab is allocated if needed
+		inline T &ref(const std::array<size_t, N> &pos)
+		{
+			std::unique_ptr<T[]> &slab = slabs[pos[0] / rows];
+			if(!slab) commit(pos[0] / rows);
+			return slab[offset(pos)];
+		}
+
+		inline const T &get(const std::array<size_t, N> &pos) const
+		{
+			const std::unique_ptr<T[]> &slab = slabs[pos[0] / rows];
+			return slab ? slab[offset(pos)] : background;
+		}
+
+		inline size_t offset(const std::array<size_t, N> &pos) const
+		{
+			size_t res = pos[0] % rows * coefs[0];
+			for(size_t i = 1; i != N; ++i) res += pos[i] * coefs[i];
+			return res;
+		}
+
+		// Number of the outer indexes in the slab
+		size_t slabRows(size_t slab) const
+		{
+			return std::min(rows, sizes[0] - slab * rows);
+		}
+
+		size_t slabVolume(size_t slab) const
+		{
+			return slabRows(slab) * coefs[0];
+		}
+
+		void commit(size_t slab)
+		{
+			if(allocate(slab)) ++committed;
+		}
+
+		// Doesn't change committed, so different slabs may be allocated concurrently
+		bool allocate(size_t slab)
+		{
+			if(slabs[slab]) return false;
+			slabs[slab].reset(new T[slabVolume(slab)]());
+			return true;
+		}
+
+		std::array<size_t, N> sizes;
+		// Row-major strides inside a slab
+		std::array<size_t, N> coefs;
+		size_t rows = 1;
+		std::vector<std::unique_ptr<T[]>> slabs;
+		size_t committed = 0;
+		const T background;
+	};
+}
+
+// Array split along the outermost dimension into slabs, which are allocated separately, so no
+// huge contiguous block is needed, and only on the first write, so the untouched parts take
+// no memory (they read as T(), reads through a non-const array don't commit either).
+// operator(), at and fix are O(1) like in vector_n. The hot loops should go slab by slab
+// (for_each_slab or slab), every slab is an ordinary dense vector_n_view.
+// Concurrent writes are safe only into the slabs which are already committed (see commit_all)
+template<class ElementType, size_t numDims>
+class vector_n_chunked : public impl::SparseSlice<ElementType, int(numDims), impl::ChunkedSlabs<ElementType, numDims>>
+{
+	typedef impl::ChunkedSlabs<ElementType, numDims> Storage;
+	typedef impl::SparseSlice<ElementType, int(numDims), Storage> Base;
+public:
+	vector_n_chunked()
+	{
+		Base::reset(&slabs);
+	}
+
+	// Slabs take about vector_n_slab_bytes
+	template<typename ... Sizes, class = std::enable_if_t<impl::AllNumeric<Sizes...>::value>>
+	vector_n_chunked(Sizes ... sizes)
+	{
+		static_assert(sizeof...(sizes) == numDims, "Parameters count is invalid");
+
+		if(!impl::allPositive(sizes ...)) throw std::invalid_argument("All dimensions must be positive");
+
+		const vector_size<numDims> dims{size_t(sizes)...};
+		resize(dims, defaultSlabRows(dims));
+	}
+
+	// Every slab holds slabRows indexes of the outermost dimension
+	vector_n_chunked(const vector_size<numDims> &sizes, size_t slabRows)
+	{
+		resize(sizes, slabRows);
+	}
+
+	vector_n_chunked(const vector_n_chunked &other) : slabs(other.slabs)
+	{
+		Base::reset(&slabs);
+	}
+
+	vector_n_chunked(vector_n_chunked &&other) noexcept : slabs(std::move(other.slabs))
+	{
+		Base::reset(&slabs);
+		other.Base::reset(&other.slabs);
+	}
+
+	vector_n_chunked &operator=(const vector_n_chunked &other)
+	{
+		if(&other != this) vector_n_chunked(other).swap(*this);
+		return *this;
+	}
+
+	vector_n_chunked &operator=(vector_n_chunked &&other) noexcept
+	{
+		if(&other != this) vector_n_chunked(std::move(other)).swap(*this);
+		return *this;
+	}
+
+	void swap(vector_n_chunked &other) noexcept
+	{
+		slabs.swap(other.slabs);
+		Base::reset(&slabs);
+		other.Base::reset(&other.slabs);
+	}
+
+	// The contents are lost
+	void resize(const vector_size<numDims> &sizes, size_t slabRows)
+	{
+		slabs.resize(sizes, slabRows);
+		Base::reset(&slabs);
+	}
+
+	template<typename ... Sizes, class = std::enable_if_t<impl::AllNumeric<Sizes...>::value>>
+	void resize(Sizes ... sizes)
+	{
+		const vector_size<numDims> dims{size_t(sizes)...};
+		resize(dims, defaultSlabRows(dims));
+	}
+
+	size_t slab_count() const
+	{
+		return slabs.slabs.size();
+	}
+
+	// Number of the outer indexes in every slab (the last one may have less)
+	size_t slab_rows() const
+	{
+		return slabs.rows;
+	}
+
+	size_t committed_slabs() const
+	{
+		return slabs.committed;
+	}
+
+	// Allocates all slabs, in parallel, so the pages are touched by the threads which
+	// will work with them (if the slabs are processed by the same threads later)
+	void commit_all(unsigned numThreads = 0)
+	{
+		impl::parallel_for_range(slab_count(), numThreads, [this](size_t begin, size_t end)
+		{
+			for(size_t i = begin; i != end; ++i) slabs.allocate(i);
+		});
+		slabs.committed = slab_count();
+	}
+
+	// Bytes of the committed slabs
+	size_t memory_bytes() const
+	{
+		size_t res = sizeof(*this) + slabs.slabs.capacity() * sizeof(slabs.slabs[0]);
+		for(size_t i = 0; i != slab_count(); ++i)
+		{
+			if(slabs.slabs[i]) res += slabs.slabVolume(i) * sizeof(ElementType);
+		}
+		return res;
+	}
+
+	// Dense view of the slab, the outer indexes [i * slab_rows(), i * slab_rows() + size(1)) of the array.
+	// The slab is committed
+	vector_n_view<ElementType, numDims> slab(size_t i)
+	{
+		if(i >= slab_count()) throw std::out_of_range("Slab index is invalid");
+		slabs.commit(i);
+		return vector_n_view<ElementType, numDims>(slabs.slabs[i].get(), slabSizes(i));
+	}
+
+	// Calls f(firstRow, view) for every slab, where firstRow is the outer index of the first row of the
+	// slab. All slabs are committed
+	template<class Function>
+	void for_each_slab(Function f)
+	{
+		for(size_t i = 0; i != slab_count(); ++i)
+		{
+			vector_n_view<ElementType, numDims> view = slab(i);
+			f(i * slabs.rows, view);
+		}
+	}
+
+	// Only the committed slabs are visited, the rest are T()
+	template<class Function>
+	void for_each_slab(Function f) const
+	{
+		for(size_t i = 0; i != slab_count(); ++i)
+		{
+			if(!slabs.slabs[i]) continue;
+			const vector_n_view<const ElementType, numDims> view(slabs.slabs[i].get(), slabSizes(i));
+			f(i * slabs.rows, view);
+		}
+	}
+
+	// Calls f for every element slab by slab in the order of memory, all slabs are committed
+	template<class Function>
+	void for_each(Function f)
+	{
+		for(size_t i = 0; i != slab_count(); ++i)
+		{
+			slabs.commit(i);
+			ElementType *ptr = slabs.slabs[i].get();
+			for(size_t j = 0, count = slabs.slabVolume(i); j != count; ++j) f(ptr[j]);
+		}
+	}
+
+private:
+	Storage slabs;
+
+	vector_size<numDims> slabSizes(size_t i) const
+	{
+		vector_size<numDims> res = Base::sizes;
+		res[0] = slabs.slabRows(i);
+		return res;
+	}
+
+	static size_t defaultSlabRows(const vector_size<numDims> &sizes)
+	{
+		size_t rowBytes = sizeof(ElementType);
+		for(size_t i = 1; i != numDims; ++i) rowBytes *= sizes[i];
+		return std::max<size_t>(vector_n_slab_bytes / std::max<size_t>(rowBytes, 1), 1);
+	}
+};
+
+template<class ElementType, size_t numDims>
+inline void swap(vector_n_chunked<ElementType, numDims> &a, vector_n_chunked<ElementType, numDims> &b) noexcept
+{
+	a.swap(b);
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include "vector_n.h"
+#include <memory>
+#include <atomic>
+
+// vector_n with copy-on-write: copies share the buffer (the reference count is atomic), so a copy
+// costs O(1), the buffer is duplicated by the first mutable access of a copy which isn't the only owner.
+// Reads go through read() and the const methods, writes through write() and the non-const methods
+// (non-const operator() is a write even if the result is only read).
+//
+// Sharing is thread-safe in the same way as std::shared_ptr: different vector_n_cow objects (copies
+// of each other too) may be used in different threads without locks, e.g. a snapshot is passed to
+// a reader thread while the writer goes on, the writer gets its own buffer on the next write.
+// One object can't be used by several threads if any of them writes.
+// A reference or slice taken from write() must not be used after the object was copied:
+// the copy shares the same buffer and would see the changes
+template<typename ElementType, size_t numDims, class Allocator = std::allocator<ElementType>>
+class vector_n_cow
+{
+public:
+	typedef vector_n<ElementType, numDims, Allocator> array_type;
+
+	vector_n_cow() : buf(std::make_shared<array_type>())
+	{
+	}
+
+	template<typename ... Sizes, class = std::enable_if_t<impl::AllNumeric<Sizes...>::value>>
+	vector_n_cow(Sizes ... sizes) : buf(std::make_shared<array_type>(sizes...))
+	{
+	}
+
+	// Takes the array over without a copy
+	explicit vector_n_cow(array_type &&array) : buf(std::make_shared<array_type>(std::move(array)))
+	{
+	}
+
+	vector_n_cow(const vector_n_cow &) = default;
+	vector_n_cow &operator=(const vector_n_cow &) = default;
+
+	// The moved-from object is empty, but still usable
+	vector_n_cow(vector_n_cow &&other) noexcept : buf(std::move(other.buf))
+	{
+	}
+
+	vector_n_cow &operator=(vector_n_cow &&other) noexcept
+	{
+		if(&other != this) buf = std::move(other.buf);
+		return *this;
+	}
+
+	void swap(vector_n_cow &other) noexcept
+	{
+		buf.swap(other.buf);
+	}
+
+	// The array for reading, nothing is copied
+	const array_type &read() const
+	{
+		return buf ? *buf : empty();
+	}
+
+	// The array for writing, the buffer is duplicated if it's shared
+	array_type &write()
+	{
+		detach();
+		return *buf;
+	}
+
+	template<typename ... Indexes>
+	inline const ElementType &operator()(Indexes ... indexes) const
+	{
+		return read()(indexes...);
+	}
+
+	template<typename ... Indexes>
+	inline ElementType &operator()(Indexes ... indexes)
+	{
+		return write()(indexes...);
+	}
+
+	inline size_t size(const int numberDims) const
+	{
+		return read().size(numberDims);
+	}
+
+	inline const vector_size<numDims> &size() const
+	{
+		return read().size();
+	}
+
+	// Makes the buffer owned by this object only
+	void detach()
+	{
+		if(!buf) buf = std::make_shared<array_type>();
+		else if(buf.use_count() != 1) buf = std::make_shared<array_type>(*buf);
+		// use_count is a relaxed load: the fence orders the writes after the reads
+		// of the other owners, which released their copies
+		else std::atomic_thread_fence(std::memory_order_acquire);
+	}
+
+	// True if the buffer is shared with other copies
+	bool shared() const
+	{
+		return buf && buf.use_count() != 1;
+	}
+
+	long use_count() const
+	{
+		return buf.use_count();
+	}
+
+private:
+	std::shared_ptr<array_type> buf;
+
+	static const array_type &empty()
+	{
+		static const array_type res;
+		return res;
+	}
+};
+
+template<typename ElementType, size_t numDims, class Allocator>
+inline void swap(vector_n_cow<ElementType, numDims, Allocator> &a, vector_n_cow<ElementType, numDims, Allocator> &b) noexcept
+{
+	a.swap(b);
+}
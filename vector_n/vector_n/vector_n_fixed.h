@@ -0,0 +1,322 @@
+#pragma once
+#include "vector_n.h"
+
+// Extent which is known only at runtime
+constexpr size_t vector_n_dynamic = size_t(-1);
+
+namespace impl
+{
+	template<size_t N>
+	constexpr size_t count_dynamic(const std::array<size_t, N> &extents, size_t to)
+	{
+		size_t res = 0;
+		for(size_t i = 0; i != to; ++i) res += extents[i] == vector_n_dynamic;
+		return res;
+	}
+
+	// Stride is a constant if all dimensions after d are static
+	template<size_t N>
+	constexpr bool has_static_stride(const std::array<size_t, N> &extents, size_t d)
+	{
+		for(size_t i = d + 1; i < N; ++i)
+		{
+			if(extents[i] == vector_n_dynamic) return false;
+		}
+		return true;
+	}
+
+	template<size_t N>
+	constexpr size_t static_stride(const std::array<size_t, N> &extents, size_t d)
+	{
+		size_t res = 1;
+		for(size_t i = d + 1; i < N; ++i) res *= extents[i];
+		return res;
+	}
+
+	// Number of elements if all extents are static, 0 otherwise
+	template<size_t N>
+	constexpr size_t static_volume(const std::array<size_t, N> &extents)
+	{
+		return count_dynamic(extents, N) == 0 ? static_stride(extents, 0) * extents[0] : 0;
+	}
+
+	template<size_t N>
+	constexpr size_t count_runtime_strides(const std::array<size_t, N> &extents, size_t to)
+	{
+		size_t res = 0;
+		for(size_t i = 0; i != to; ++i) res += !has_static_stride(extents, i);
+		return res;
+	}
+}
+
+// Non-owning view with the row-major layout, where some or all extents are template constants.
+// Only the dynamic extents and the strides, which depend on them, are stored,
+// other strides are constexpr, so the index calculation is folded by the compiler
+template<class ElementType, size_t ... Extents>
+class vector_n_fixed_view
+{
+public:
+	static constexpr size_t rank = sizeof...(Extents);
+	static constexpr std::array<size_t, rank> extents{Extents...};
+	static constexpr size_t numDynamic = impl::count_dynamic(extents, rank);
+	static constexpr size_t numRuntimeStrides = impl::count_runtime_strides(extents, rank);
+
+	static_assert(rank > 0, "At least one dimension is required");
+
+	vector_n_fixed_view() : data(nullptr), dynamicSizes{}, runtimeStrides{}
+	{
+	}
+
+	template<typename ... Sizes>
+	explicit vector_n_fixed_view(ElementType *ptr, Sizes ... dynamicExtents)
+		: data(nullptr), dynamicSizes{}, runtimeStrides{}
+	{
+		static_assert(sizeof...(Sizes) == numDynamic, "Parameters count must be equal to the number of dynamic extents");
+		static_assert(impl::AllNumeric<Sizes...>::value, "Parameters type is invalid");
+
+		reset({size_t(dynamicExtents)...}, ptr);
+	}
+
+	template<typename ... Indexes>
+	inline ElementType& operator()(Indexes ... indexes) const
+	{
+		static_assert(impl::AllNumeric<Indexes...>::value, "Parameters type is invalid");
+		static_assert(sizeof...(indexes) == rank, "Parameters count is invalid");
+		assert(impl::checkIndex(size().data(), indexes...) && "Indexes is invalid.");
+
+		return data[offset(std::make_index_sequence<rank>(), indexes...)];
+	}
+
+	template<typename ... Indexes>
+	inline ElementType& at(Indexes ... indexes) const
+	{
+		static_assert(impl::AllNumeric<Indexes...>::value, "Parameters type is invalid");
+		static_assert(sizeof...(indexes) == rank, "Parameters count is invalid");
+
+		if(!impl::checkIndex(size().data(), indexes...)) throw std::out_of_range("One or more indexes are invalid");
+
+		return data[offset(std::make_index_sequence<rank>(), indexes...)];
+	}
+
+	inline size_t size(const int numberDims) const
+	{
+		assert(numberDims >= 1 && numberDims <= int(rank) && "Parameters count is invalid");
+
+		return extent(numberDims - 1);
+	}
+
+	inline vector_size<rank> size() const
+	{
+		vector_size<rank> res;
+		for(size_t i = 0; i != rank; ++i) res[i] = extent(i);
+		return res;
+	}
+
+	inline ElementType *origin() const
+	{
+		return data;
+	}
+
+	// Ordinary slice over the same memory for fix, get_indexer, expressions and so on
+	impl::VectorSlice<ElementType, rank> view() const
+	{
+		return make_slice<ElementType>();
+	}
+
+protected:
+	template<class T>
+	impl::VectorSlice<T, rank> make_slice() const
+	{
+		std::array<size_t, rank + 1> coefs;
+		coefs[rank] = 0;
+		for(size_t i = 0; i != rank; ++i) coefs[i] = stride(i);
+
+		impl::VectorSlice<T, rank> res;
+		res.reset(coefs, size(), data);
+		return res;
+	}
+
+	void reset(const std::array<size_t, numDynamic> &adynamicSizes, ElementType *adata)
+	{
+		dynamicSizes = adynamicSizes;
+		data = adata;
+
+		size_t cur = 1;
+		for(int i = int(rank) - 1; i >= 0; --i)
+		{
+			if(!impl::has_static_stride(extents, i)) runtimeStrides[impl::count_runtime_strides(extents, i)] = cur;
+			cur *= extent(i);
+		}
+	}
+
+	void set_buf(ElementType *ptr)
+	{
+		data = ptr;
+	}
+
+	// Number of elements
+	size_t count() const
+	{
+		size_t res = 1;
+		for(size_t i = 0; i != rank; ++i) res *= extent(i);
+		return res;
+	}
+
+private:
+	ElementType *data;
+	std::array<size_t, numDynamic> dynamicSizes;
+	std::array<size_t, numRuntimeStrides> runtimeStrides;
+
+	inline size_t extent(size_t d) const
+	{
+		return extents[d] != vector_n_dynamic ? extents[d] : dynamicSizes[impl::count_dynamic(extents, d)];
+	}
+
+	inline size_t stride(size_t d) const
+	{
+		return impl::has_static_stride(extents, d) ? impl::static_stride(extents, d) :
+			runtimeStrides[impl::count_runtime_strides(extents, d)];
+	}
+
+	template<size_t D>
+	inline size_t stride() const
+	{
+		if constexpr (impl::has_static_stride(extents, D)) return impl::static_stride(extents, D);
+		else return runtimeStrides[impl::count_runtime_strides(extents, D)];
+	}
+
+	template<size_t ... D, typename ... Indexes>
+	inline size_t offset(std::index_sequence<D...>, Indexes ... indexes) const
+	{
+		return ((size_t(indexes) * stride<D>()) + ...);
+	}
+};
+
+// Owning array with fixed extents. If all extents are static, the elements are stored inline
+template<class ElementType, size_t ... Extents>
+class vector_n_fixed : public vector_n_fixed_view<ElementType, Extents...>
+{
+	typedef vector_n_fixed_view<ElementType, Extents...> Base;
+	static constexpr bool allStatic = Base::numDynamic == 0;
+	typedef std::conditional_t<allStatic, 
+		std::array<ElementType, impl::static_volume(Base::extents)>,
+		std::vector<ElementType>> Storage;
+public:
+	template<typename ... Sizes>
+	explicit vector_n_fixed(Sizes ... dynamicExtents)
+	{
+		static_assert(sizeof...(Sizes) == Base::numDynamic, "Parameters count must be equal to the number of dynamic extents");
+		static_assert(impl::AllNumeric<Sizes...>::value, "Parameters type is invalid");
+
+		if(!impl::allPositive(dynamicExtents...)) throw std::invalid_argument("All dimensions must be positive");
+
+		Base::reset({size_t(dynamicExtents)...}, nullptr);
+		if constexpr (allStatic) data.fill(ElementType());
+		else data.resize(Base::count());
+		Base::set_buf(data.data());
+	}
+
+	vector_n_fixed(const vector_n_fixed &other)
+		: Base(other), data(other.data)
+	{
+		Base::set_buf(data.data());
+	}
+
+	vector_n_fixed(vector_n_fixed &&other) noexcept
+		: Base(other), data(std::move(other.data))
+	{
+		Base::set_buf(data.data());
+		if constexpr (!allStatic) other.Base::reset({}, nullptr);
+	}
+
+	vector_n_fixed &operator=(const vector_n_fixed &other)
+	{
+		if(&other != this)
+		{
+			data = other.data;
+			*static_cast<Base*>(this) = static_cast<const Base&>(other);
+			Base::set_buf(data.data());
+		}
+		return *this;
+	}
+
+	vector_n_fixed &operator=(vector_n_fixed &&other) noexcept
+	{
+		if(&other != this)
+		{
+			data = std::move(other.data);
+			*static_cast<Base*>(this) = static_cast<const Base&>(other);
+			Base::set_buf(data.data());
+			if constexpr (!allStatic) other.Base::reset({}, nullptr);
+		}
+		return *this;
+	}
+
+	// Unlike the view, constant array gives only constant elements
+	template<typename ... Indexes>
+	inline ElementType& operator()(Indexes ... indexes)
+	{
+		return Base::operator()(indexes...);
+	}
+
+	template<typename ... Indexes>
+	inline const ElementType& operator()(Indexes ... indexes) const
+	{
+		return Base::operator()(indexes...);
+	}
+
+	template<typename ... Indexes>
+	inline ElementType& at(Indexes ... indexes)
+	{
+		return Base::at(indexes...);
+	}
+
+	template<typename ... Indexes>
+	inline const ElementType& at(Indexes ... indexes) const
+	{
+		return Base::at(indexes...);
+	}
+
+	inline ElementType *origin()
+	{
+		return data.data();
+	}
+
+	inline const ElementType *origin() const
+	{
+		return data.data();
+	}
+
+	impl::VectorSlice<ElementType, Base::rank> view()
+	{
+		return Base::view();
+	}
+
+	impl::VectorSlice<const ElementType, Base::rank> view() const
+	{
+		return Base::template make_slice<const ElementType>();
+	}
+
+	ElementType *begin()
+	{
+		return data.data();
+	}
+
+	ElementType *end()
+	{
+		return data.data() + data.size();
+	}
+
+	const ElementType *begin() const
+	{
+		return data.data();
+	}
+
+	const ElementType *end() const
+	{
+		return data.data() + data.size();
+	}
+
+private:
+	Storage data;
+};
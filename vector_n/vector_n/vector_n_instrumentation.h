@@ -0,0 +1,166 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <type_traits>
+#ifdef VECTOR_N_INSTRUMENTATION
+#include <atomic>
+#include <mutex>
+#include <typeinfo>
+#endif
+
+// Counters of the hot paths of one element type and rank. They are collected only if
+// VECTOR_N_INSTRUMENTATION is defined, otherwise the hooks expand to nothing and all counters are 0
+struct vector_n_counters
+{
+	// Buffer allocations of vector_n (resize, copy) and their size
+	uint64_t allocations = 0;
+	uint64_t allocated_bytes = 0;
+	// Deep copies of vector_n and the bytes copied
+	uint64_t copies = 0;
+	uint64_t copied_bytes = 0;
+	// Slices built by fix, slice and permuted_view
+	uint64_t slices = 0;
+	// Increments of the element iterators and how many of them moved to the next row
+	uint64_t iterator_steps = 0;
+	uint64_t iterator_wraps = 0;
+	// Indexes rejected by at and fix
+	uint64_t bounds_failures = 0;
+};
+
+struct vector_n_stats_entry
+{
+	std::string type;
+	int rank;
+	vector_n_counters counters;
+};
+
+namespace impl
+{
+	enum class Counter { allocations, allocated_bytes, copies, copied_bytes, slices, iterator_steps, iterator_wraps, bounds_failures, count };
+
+#ifdef VECTOR_N_INSTRUMENTATION
+	struct CounterSet
+	{
+		std::string type;
+		int rank;
+		std::atomic<uint64_t> values[size_t(Counter::count)];
+
+		vector_n_counters load() const
+		{
+			auto get = [this](Counter c) { return values[size_t(c)].load(std::memory_order_relaxed); };
+			vector_n_counters res;
+			res.allocations = get(Counter::allocations);
+			res.allocated_bytes = get(Counter::allocated_bytes);
+			res.copies = get(Counter::copies);
+			res.copied_bytes = get(Counter::copied_bytes);
+			res.slices = get(Counter::slices);
+			res.iterator_steps = get(Counter::iterator_steps);
+			res.iterator_wraps = get(Counter::iterator_wraps);
+			res.bounds_failures = get(Counter::bounds_failures);
+			return res;
+		}
+	};
+
+	// All counter sets created so far
+	struct CounterRegistry
+	{
+		std::mutex mutex;
+		std::vector<CounterSet*> sets;
+	};
+
+	inline CounterRegistry &counter_registry()
+	{
+		static CounterRegistry registry;
+		return registry;
+	}
+
+	template<class T>
+	std::string counter_type_name()
+	{
+		if constexpr(std::is_same_v<T, float>) return "float";
+		else if constexpr(std::is_same_v<T, double>) return "double";
+		else if constexpr(std::is_same_v<T, char>) return "char";
+		else if constexpr(std::is_same_v<T, int>) return "int";
+		else if constexpr(std::is_same_v<T, unsigned>) return "unsigned";
+		else if constexpr(std::is_same_v<T, long long>) return "long long";
+		else if constexpr(std::is_same_v<T, size_t>) return "size_t";
+		else return typeid(T).name();
+	}
+
+	template<class T, int N>
+	CounterSet &counter_set()
+	{
+		static CounterSet set{counter_type_name<T>(), N, {}};
+		static const bool registered = []
+		{
+			CounterRegistry &registry = counter_registry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			registry.sets.push_back(&set);
+			return true;
+		}();
+		(void)registered;
+		return set;
+	}
+
+	template<class T, int N>
+	inline void count(Counter c, uint64_t n)
+	{
+		counter_set<std::remove_const_t<T>, N>().values[size_t(c)].fetch_add(n, std::memory_order_relaxed);
+	}
+#endif
+}
+
+#ifdef VECTOR_N_INSTRUMENTATION
+#define VECTOR_N_COUNT(T, N, counter, n) ::impl::count<T, int(N)>(::impl::Counter::counter, uint64_t(n))
+#else
+#define VECTOR_N_COUNT(T, N, counter, n) ((void)0)
+#endif
+
+// Counters of the element type and rank
+template<class T, size_t N>
+vector_n_counters vector_n_stats()
+{
+#ifdef VECTOR_N_INSTRUMENTATION
+	return impl::counter_set<std::remove_const_t<T>, int(N)>().load();
+#else
+	return vector_n_counters();
+#endif
+}
+
+// Counters of all element types and ranks which were used, in the order of the first use
+inline std::vector<vector_n_stats_entry> vector_n_stats_snapshot()
+{
+	std::vector<vector_n_stats_entry> res;
+#ifdef VECTOR_N_INSTRUMENTATION
+	impl::CounterRegistry &registry = impl::counter_registry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	for(const impl::CounterSet *set : registry.sets) res.push_back({set->type, set->rank, set->load()});
+#endif
+	return res;
+}
+
+inline void vector_n_stats_reset()
+{
+#ifdef VECTOR_N_INSTRUMENTATION
+	impl::CounterRegistry &registry = impl::counter_registry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	for(impl::CounterSet *set : registry.sets)
+	{
+		for(auto &value : set->values) value.store(0, std::memory_order_relaxed);
+	}
+#endif
+}
+
+// One line per element type and rank
+inline void vector_n_stats_dump(std::ostream &out)
+{
+	for(const vector_n_stats_entry &e : vector_n_stats_snapshot())
+	{
+		const vector_n_counters &c = e.counters;
+		out << e.type << '[' << e.rank << "]: allocations " << c.allocations << " (" << c.allocated_bytes << " bytes), copies "
+			<< c.copies << " (" << c.copied_bytes << " bytes), slices " << c.slices << ", iterator steps " << c.iterator_steps
+			<< " (" << c.iterator_wraps << " wraps), bounds failures " << c.bounds_failures << '\n';
+	}
+}
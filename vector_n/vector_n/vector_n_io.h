@@ -0,0 +1,368 @@
+#pragma once
+#include "vector_n.h"
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <tuple>
+#include <istream>
+#include <ostream>
+#include <fstream>
+#include <stdexcept>
+
+// Saving and loading in the .npy format (numpy.save / numpy.load).
+// The data is streamed through a buffer of the fixed size, so any view (including strided ones)
+// is written without making a dense copy, and the dense parts are written directly from memory
+
+// Default size of the buffer in bytes
+const size_t vector_n_io_chunk = size_t(1) << 22;
+
+namespace impl
+{
+	inline bool is_little_endian()
+	{
+		const uint16_t value = 1;
+		unsigned char byte;
+		std::memcpy(&byte, &value, 1);
+		return byte == 1;
+	}
+
+	// Type description of the element, for example '<f8'
+	template<class T>
+	std::string npy_descr()
+	{
+		const char order = sizeof(T) == 1 || element_kind<T>() == 'V' ? '|' : (is_little_endian() ? '<' : '>');
+		return order + std::string(1, element_kind<T>()) + std::to_string(sizeof(T));
+	}
+
+	inline void byte_swap(char *data, size_t count, size_t elementSize)
+	{
+		for(size_t i = 0; i != count; ++i, data += elementSize) std::reverse(data, data + elementSize);
+	}
+
+	// Calls f(ptr, length, stride) for every row of the view in the order of the file
+	template<class T, size_t N, class Function>
+	void for_each_row(T *origin, const std::array<size_t, N> &sizes, const std::array<size_t, N> &strides, Function f)
+	{
+		size_t rows = 1;
+		for(size_t i = 0; i + 1 < N; ++i) rows *= sizes[i];
+		if(rows == 0 || sizes[N - 1] == 0) return;
+
+		std::array<size_t, N> pos{};
+		for(size_t r = 0; r != rows; ++r)
+		{
+			T *ptr = origin;
+			for(size_t i = 0; i + 1 < N; ++i) ptr += pos[i] * strides[i];
+			f(ptr, sizes[N - 1], strides[N - 1]);
+
+			for(size_t i = N - 1; i-- > 0;)
+			{
+				if(++pos[i] != sizes[i]) break;
+				pos[i] = 0;
+			}
+		}
+	}
+
+	template<class T, size_t N>
+	void write_npy_data(std::ostream &out, const T *origin, const std::array<size_t, N> &sizes,
+		const std::array<size_t, N> &strides, size_t chunkBytes)
+	{
+		const size_t chunk = std::max<size_t>(chunkBytes / sizeof(T), 1);
+		auto write = [&out](const T *ptr, size_t count)
+		{
+			out.write(reinterpret_cast<const char*>(ptr), std::streamsize(count * sizeof(T)));
+			if(!out) throw std::runtime_error("Can't write the data");
+		};
+
+		size_t count = 1;
+		for(size_t size : sizes) count *= size;
+		if(is_dense(sizes, strides))
+		{
+			for(size_t i = 0; i < count; i += chunk) write(origin + i, std::min(chunk, count - i));
+			return;
+		}
+
+		std::vector<T> buffer(std::min(chunk, count));
+		size_t filled = 0;
+		for_each_row(origin, sizes, strides, [&](const T *ptr, size_t len, size_t stride)
+		{
+			// Long contiguous rows don't need the buffer
+			if(stride == 1 && len >= chunk)
+			{
+				write(buffer.data(), filled);
+				filled = 0;
+				write(ptr, len);
+				return;
+			}
+			while(len != 0)
+			{
+				const size_t n = std::min(len, buffer.size() - filled);
+				T *dst = buffer.data() + filled;
+				if(stride == 1) std::memcpy(dst, ptr, n * sizeof(T));
+				else for(size_t i = 0; i != n; ++i) dst[i] = ptr[i * stride];
+
+				ptr += n * stride;
+				len -= n;
+				filled += n;
+				if(filled == buffer.size())
+				{
+					write(buffer.data(), filled);
+					filled = 0;
+				}
+			}
+		});
+		write(buffer.data(), filled);
+	}
+
+	template<class T, size_t N>
+	void read_npy_data(std::istream &in, T *origin, const std::array<size_t, N> &sizes,
+		const std::array<size_t, N> &strides, bool swapBytes, size_t chunkBytes)
+	{
+		const size_t chunk = std::max<size_t>(chunkBytes / sizeof(T), 1);
+		auto read = [&in, swapBytes](T *ptr, size_t count)
+		{
+			in.read(reinterpret_cast<char*>(ptr), std::streamsize(count * sizeof(T)));
+			if(!in) throw std::runtime_error("File is truncated");
+			if(swapBytes) byte_swap(reinterpret_cast<char*>(ptr), count, sizeof(T));
+		};
+
+		size_t count = 1;
+		for(size_t size : sizes) count *= size;
+		if(is_dense(sizes, strides))
+		{
+			for(size_t i = 0; i < count; i += chunk) read(origin + i, std::min(chunk, count - i));
+			return;
+		}
+
+		std::vector<T> buffer(std::min(chunk, count));
+		size_t available = 0, used = 0;
+		for_each_row(origin, sizes, strides, [&](T *ptr, size_t len, size_t stride)
+		{
+			if(stride == 1 && len >= chunk && used == available)
+			{
+				read(ptr, len);
+				count -= len;
+				return;
+			}
+			while(len != 0)
+			{
+				if(used == available)
+				{
+					// Don't read beyond the data, the stream may contain something else after it
+					available = std::min(buffer.size(), count);
+					count -= available;
+					used = 0;
+					read(buffer.data(), available);
+				}
+				const size_t n = std::min(len, available - used);
+				const T *src = buffer.data() + used;
+				if(stride == 1) std::memcpy(ptr, src, n * sizeof(T));
+				else for(size_t i = 0; i != n; ++i) ptr[i * stride] = src[i];
+
+				ptr += n * stride;
+				len -= n;
+				used += n;
+			}
+		});
+	}
+
+	struct NpyHeader
+	{
+		std::string descr;
+		bool fortranOrder = false;
+		std::vector<size_t> shape;
+	};
+
+	// Value of the key in the header dictionary, without the parsing of nested structures
+	inline std::string npy_value(const std::string &header, const std::string &key)
+	{
+		size_t pos = header.find("'" + key + "'");
+		if(pos == std::string::npos) throw std::runtime_error("Invalid npy header: no " + key);
+		pos = header.find(':', pos);
+		if(pos == std::string::npos) throw std::runtime_error("Invalid npy header");
+		pos = header.find_first_not_of(' ', pos + 1);
+		if(pos == std::string::npos) throw std::runtime_error("Invalid npy header");
+
+		size_t end;
+		if(header[pos] == '(') end = header.find(')', pos) + 1;
+		else if(header[pos] == '\'') end = header.find('\'', pos + 1) + 1;
+		else end = header.find_first_of(",}", pos);
+		if(end == std::string::npos || end == 0) throw std::runtime_error("Invalid npy header");
+		return header.substr(pos, end - pos);
+	}
+
+	// numpy refuses longer headers by default (max_header_size of numpy.load)
+	constexpr size_t npyMaxHeader = 10000;
+
+	inline NpyHeader read_npy_header(std::istream &in)
+	{
+		char magic[8];
+		in.read(magic, sizeof(magic));
+		if(!in || std::memcmp(magic, "\x93NUMPY", 6) != 0) throw std::runtime_error("Not a npy file");
+
+		// Version 1 has 2-byte length, versions 2 and 3 have 4-byte one
+		const int lengthBytes = magic[6] == 1 ? 2 : 4;
+		if(magic[6] < 1 || magic[6] > 3) throw std::runtime_error("Unsupported npy version");
+		unsigned char lengthData[4];
+		in.read(reinterpret_cast<char*>(lengthData), lengthBytes);
+		if(!in) throw std::runtime_error("Invalid npy header");
+		size_t length = 0;
+		for(int i = lengthBytes - 1; i >= 0; --i) length = length * 256 + lengthData[i];
+		if(length > npyMaxHeader) throw std::runtime_error("npy header is too long");
+
+		std::string header(length, ' ');
+		in.read(&header[0], std::streamsize(length));
+		if(!in) throw std::runtime_error("Invalid npy header");
+
+		NpyHeader res;
+		const std::string descr = npy_value(header, "descr");
+		if(descr.size() < 2 || descr.front() != '\'') throw std::runtime_error("Unsupported npy element type " + descr);
+		res.descr = descr.substr(1, descr.size() - 2);
+		res.fortranOrder = npy_value(header, "fortran_order") == "True";
+
+		const std::string shape = npy_value(header, "shape");
+		for(size_t pos = 1; pos < shape.size();)
+		{
+			pos = shape.find_first_of("0123456789", pos);
+			if(pos == std::string::npos) break;
+			size_t end = shape.find_first_not_of("0123456789", pos);
+			res.shape.push_back(size_t(std::stoull(shape.substr(pos, end - pos))));
+			pos = end;
+		}
+		return res;
+	}
+
+	template<size_t N>
+	void write_npy_header(std::ostream &out, const std::string &descr, const std::array<size_t, N> &sizes, bool fortranOrder)
+	{
+		std::string header = "{'descr': '" + descr + "', 'fortran_order': " + (fortranOrder ? "True" : "False") + ", 'shape': (";
+		for(size_t size : sizes) header += std::to_string(size) + ", ";
+		header.resize(header.size() - (N > 1 ? 2 : 1));
+		header += "), }";
+
+		// The data begins at the multiple of 64 bytes
+		const size_t prefix = 10;
+		header.resize((prefix + header.size() + 1 + 63) / 64 * 64 - prefix - 1, ' ');
+		header += '\n';
+		if(header.size() > 0xFFFF) throw std::invalid_argument("Rank is too big");
+
+		const char magic[8] = {'\x93', 'N', 'U', 'M', 'P', 'Y', 1, 0};
+		const char length[2] = {char(header.size() & 0xFF), char(header.size() >> 8)};
+		out.write(magic, sizeof(magic));
+		out.write(length, sizeof(length));
+		out.write(header.data(), std::streamsize(header.size()));
+		if(!out) throw std::runtime_error("Can't write the header");
+	}
+
+	template<size_t N>
+	struct NpyLayout
+	{
+		vector_size<N> sizes{};
+		bool fortranOrder = false;
+		bool swapBytes = false;
+	};
+
+	// Reads the header and checks that it's compatible with the type and rank
+	template<class T, size_t N>
+	NpyLayout<N> read_npy_layout(std::istream &in)
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "Element type must be trivially copyable");
+
+		const NpyHeader header = read_npy_header(in);
+		const std::string expected = npy_descr<T>();
+		if(header.descr.size() != expected.size() || header.descr.substr(1) != expected.substr(1))
+			throw std::runtime_error("Element type " + header.descr + " differs from " + expected);
+		if(header.shape.size() != N) throw std::runtime_error("Rank of the file differs");
+
+		NpyLayout<N> res;
+		std::copy(header.shape.begin(), header.shape.end(), res.sizes.begin());
+		res.fortranOrder = header.fortranOrder;
+		res.swapBytes = sizeof(T) > 1 && header.descr[0] != expected[0] && header.descr[0] != '|';
+		return res;
+	}
+
+	// Fortran order is the C order of the view with the reversed dimensions
+	template<class T, size_t N>
+	void read_npy_into(std::istream &in, const NpyLayout<N> &layout, T *origin, vector_size<N> strides, size_t chunkBytes)
+	{
+		vector_size<N> sizes = layout.sizes;
+		if(layout.fortranOrder)
+		{
+			std::reverse(sizes.begin(), sizes.end());
+			std::reverse(strides.begin(), strides.end());
+		}
+		read_npy_data(in, origin, sizes, strides, layout.swapBytes, chunkBytes);
+	}
+}
+
+template<class ElementType, int numDims>
+void save_npy(std::ostream &out, const impl::VectorSlice<ElementType, numDims> &slice, size_t chunkBytes = vector_n_io_chunk)
+{
+	typedef std::remove_const_t<ElementType> T;
+	static_assert(std::is_trivially_copyable_v<T>, "Element type must be trivially copyable");
+
+	// Column-major data is written as is with the Fortran order
+	vector_size<numDims> sizes = slice.size(), strides = slice.strides();
+	std::reverse(sizes.begin(), sizes.end());
+	std::reverse(strides.begin(), strides.end());
+	const bool fortranOrder = numDims > 1 && !impl::is_dense(slice.size(), slice.strides()) && impl::is_dense(sizes, strides);
+	if(!fortranOrder)
+	{
+		sizes = slice.size();
+		strides = slice.strides();
+	}
+
+	impl::write_npy_header<numDims>(out, impl::npy_descr<T>(), slice.size(), fortranOrder);
+	impl::write_npy_data<T, numDims>(out, slice.origin(), sizes, strides, chunkBytes);
+}
+
+template<class ElementType, int numDims>
+void save_npy(const std::string &path, const impl::VectorSlice<ElementType, numDims> &slice, size_t chunkBytes = vector_n_io_chunk)
+{
+	std::ofstream out(path, std::ios::binary);
+	if(!out) throw std::runtime_error("Can't open " + path);
+	save_npy(out, slice, chunkBytes);
+	out.close();
+	if(!out) throw std::runtime_error("Can't write " + path);
+}
+
+// Reads the data into the existing view, sizes must match
+template<class ElementType, int numDims>
+void load_npy(std::istream &in, const impl::VectorSlice<ElementType, numDims> &dst, size_t chunkBytes = vector_n_io_chunk)
+{
+	static_assert(!std::is_const_v<ElementType>, "Can't load into the const view");
+
+	const auto layout = impl::read_npy_layout<ElementType, numDims>(in);
+	if(layout.sizes != dst.size()) throw std::invalid_argument("Sizes of the file and the view differ");
+	impl::read_npy_into<ElementType, numDims>(in, layout, dst.origin(), dst.strides(), chunkBytes);
+}
+
+// The elements are created with vector_n_init::none (kept for the following resize), so with
+// default_init_allocator they are written only once, by the reading
+template<class ElementType, size_t numDims, class Allocator = std::allocator<ElementType>>
+vector_n<ElementType, numDims, Allocator> load_npy(std::istream &in, size_t chunkBytes = vector_n_io_chunk)
+{
+	const auto layout = impl::read_npy_layout<ElementType, numDims>(in);
+
+	auto res = std::apply([](auto ... sizes)
+	{
+		return vector_n<ElementType, numDims, Allocator>(vector_n_init::none, sizes...);
+	}, layout.sizes);
+	impl::read_npy_into<ElementType, numDims>(in, layout, res.origin(), res.strides(), chunkBytes);
+	return res;
+}
+
+template<class ElementType, int numDims>
+void load_npy(const std::string &path, const impl::VectorSlice<ElementType, numDims> &dst, size_t chunkBytes = vector_n_io_chunk)
+{
+	std::ifstream in(path, std::ios::binary);
+	if(!in) throw std::runtime_error("Can't open " + path);
+	load_npy(in, dst, chunkBytes);
+}
+
+template<class ElementType, size_t numDims, class Allocator = std::allocator<ElementType>>
+vector_n<ElementType, numDims, Allocator> load_npy(const std::string &path, size_t chunkBytes = vector_n_io_chunk)
+{
+	std::ifstream in(path, std::ios::binary);
+	if(!in) throw std::runtime_error("Can't open " + path);
+	return load_npy<ElementType, numDims, Allocator>(in, chunkBytes);
+}
@@ -0,0 +1,370 @@
+#pragma once
+#include "vector_n.h"
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <limits>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Expected access pattern of the mapped memory
+enum class vector_n_advice { normal, sequential, random, will_need };
+
+namespace impl
+{
+	// Whole file mapped into memory
+	class MappedFile
+	{
+	public:
+		MappedFile() {}
+
+		// Opens existing file or creates the new one of the given size if size isn't 0
+		MappedFile(const std::string &path, bool writable, size_t size = 0)
+			: m_writable(writable)
+		{
+			// The destructor isn't called if the constructor throws
+			try
+			{
+				open(path, writable, size);
+			}
+			catch(...)
+			{
+				close();
+				throw;
+			}
+		}
+
+		MappedFile(const MappedFile &) = delete;
+		MappedFile &operator=(const MappedFile &) = delete;
+
+		MappedFile(MappedFile &&other) noexcept
+		{
+			swap(other);
+		}
+
+		MappedFile &operator=(MappedFile &&other) noexcept
+		{
+			MappedFile(std::move(other)).swap(*this);
+			return *this;
+		}
+
+		~MappedFile()
+		{
+			close();
+		}
+
+		void swap(MappedFile &other) noexcept
+		{
+			std::swap(m_data, other.m_data);
+			std::swap(m_size, other.m_size);
+			std::swap(m_writable, other.m_writable);
+			std::swap(m_file, other.m_file);
+#ifdef _WIN32
+			std::swap(m_mapping, other.m_mapping);
+#endif
+		}
+
+		void *data() const { return m_data; }
+		size_t size() const { return m_size; }
+		bool writable() const { return m_writable; }
+
+		// Writes the changes of the range to the file and waits for it
+		void flush(const void *ptr, size_t bytes) const
+		{
+			if(!m_writable || m_data == nullptr) return;
+#ifdef _WIN32
+			if(!FlushViewOfFile(ptr, bytes) || !FlushFileBuffers(m_file)) throw_error("Can't flush the mapped file");
+#else
+			// msync needs the address aligned to the page
+			const uintptr_t page = uintptr_t(::sysconf(_SC_PAGESIZE));
+			const uintptr_t begin = uintptr_t(ptr) / page * page;
+			if(::msync(reinterpret_cast<void*>(begin), uintptr_t(ptr) + bytes - begin, MS_SYNC) != 0)
+				throw_error("Can't flush the mapped file");
+#endif
+		}
+
+		// Only a hint, errors are ignored. Windows has no such hints, so it does nothing there
+		void advise(vector_n_advice advice) const
+		{
+#ifndef _WIN32
+			if(m_data == nullptr) return;
+			int flag = MADV_NORMAL;
+			switch(advice)
+			{
+			case vector_n_advice::normal: flag = MADV_NORMAL; break;
+			case vector_n_advice::sequential: flag = MADV_SEQUENTIAL; break;
+			case vector_n_advice::random: flag = MADV_RANDOM; break;
+			case vector_n_advice::will_need: flag = MADV_WILLNEED; break;
+			}
+			::madvise(m_data, m_size, flag);
+#else
+			(void)advice;
+#endif
+		}
+
+		void close() noexcept
+		{
+#ifdef _WIN32
+			if(m_data != nullptr) UnmapViewOfFile(m_data);
+			if(m_mapping != nullptr) CloseHandle(m_mapping);
+			if(m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+			m_mapping = nullptr;
+			m_file = INVALID_HANDLE_VALUE;
+#else
+			if(m_data != nullptr) ::munmap(m_data, m_size);
+			if(m_file != -1) ::close(m_file);
+			m_file = -1;
+#endif
+			m_data = nullptr;
+			m_size = 0;
+		}
+
+	private:
+		void open(const std::string &path, bool writable, size_t size)
+		{
+#ifdef _WIN32
+			m_file = CreateFileA(path.c_str(), writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+				FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, size != 0 ? CREATE_ALWAYS : OPEN_EXISTING,
+				FILE_ATTRIBUTE_NORMAL, nullptr);
+			if(m_file == INVALID_HANDLE_VALUE) throw_error("Can't open " + path);
+
+			if(size == 0)
+			{
+				LARGE_INTEGER fileSize;
+				if(!GetFileSizeEx(m_file, &fileSize)) throw_error("Can't get size of " + path);
+				size = size_t(fileSize.QuadPart);
+			}
+			m_size = size;
+			if(m_size == 0) throw std::runtime_error("File " + path + " is empty");
+
+			m_mapping = CreateFileMappingA(m_file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY,
+				DWORD(uint64_t(size) >> 32), DWORD(size), nullptr);
+			if(m_mapping == nullptr) throw_error("Can't map " + path);
+
+			m_data = MapViewOfFile(m_mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size);
+			if(m_data == nullptr) throw_error("Can't map " + path);
+#else
+			m_file = ::open(path.c_str(), writable ? (size != 0 ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR) : O_RDONLY, 0644);
+			if(m_file == -1) throw_error("Can't open " + path);
+
+			if(size != 0)
+			{
+				if(::ftruncate(m_file, off_t(size)) != 0) throw_error("Can't resize " + path);
+			}
+			else
+			{
+				struct stat st;
+				if(::fstat(m_file, &st) != 0) throw_error("Can't get size of " + path);
+				size = size_t(st.st_size);
+			}
+			m_size = size;
+			if(m_size == 0) throw std::runtime_error("File " + path + " is empty");
+
+			m_data = ::mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, m_file, 0);
+			if(m_data == MAP_FAILED)
+			{
+				m_data = nullptr;
+				throw_error("Can't map " + path);
+			}
+#endif
+		}
+
+		void *m_data = nullptr;
+		size_t m_size = 0;
+		bool m_writable = false;
+#ifdef _WIN32
+		HANDLE m_file = INVALID_HANDLE_VALUE;
+		HANDLE m_mapping = nullptr;
+
+		[[noreturn]] static void throw_error(const std::string &message)
+		{
+			throw std::system_error(int(GetLastError()), std::system_category(), message);
+		}
+#else
+		int m_file = -1;
+
+		[[noreturn]] static void throw_error(const std::string &message)
+		{
+			throw std::system_error(errno, std::generic_category(), message);
+		}
+#endif
+	};
+
+	// Header of the file, the extents (uint64_t each) follow it.
+	// All values are in the native byte order
+	struct MappedHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t rank;
+		uint32_t elementSize;
+		uint32_t elementKind;
+		uint64_t dataOffset;
+	};
+
+	const char mappedMagic[8] = {'V', 'E', 'C', 'T', 'O', 'R', '_', 'N'};
+	const uint32_t mappedVersion = 1;
+}
+
+// vector_n stored in a file, which is mapped into memory, so the data is loaded lazily
+// and shared through the page cache between processes. The file is a small header
+// (rank, element type and extents) followed by the elements in the natural layout.
+// vector_n_mapped<const T, N> maps the file read-only.
+// Changes are written by the OS at any time, flush() waits until they are written
+template<class ElementType, size_t numDims>
+class vector_n_mapped : public impl::VectorSlice<ElementType, numDims>
+{
+	typedef impl::VectorSlice<ElementType, numDims> Base;
+	typedef std::remove_const_t<ElementType> ValueType;
+	static_assert(std::is_trivially_copyable_v<ValueType>, "Element type must be trivially copyable");
+public:
+	vector_n_mapped()
+	{
+	}
+
+	// Maps the existing file, element type and rank must match
+	explicit vector_n_mapped(const std::string &path)
+		: file(path, !std::is_const_v<ElementType>)
+	{
+		if(file.size() < sizeof(impl::MappedHeader)) throw std::runtime_error("File " + path + " is too small");
+
+		impl::MappedHeader header;
+		std::memcpy(&header, file.data(), sizeof(header));
+		if(std::memcmp(header.magic, impl::mappedMagic, sizeof(header.magic)) != 0 || header.version != impl::mappedVersion)
+			throw std::runtime_error("File " + path + " has unknown format");
+		if(header.rank != numDims || header.elementSize != sizeof(ValueType) ||
+			header.elementKind != uint32_t(impl::element_kind<ValueType>()))
+			throw std::runtime_error("File " + path + " has different element type or rank");
+		if(header.dataOffset < headerSize() || header.dataOffset % alignof(ValueType) != 0)
+			throw std::runtime_error("File " + path + " is damaged");
+		if(file.size() < headerSize() || file.size() < header.dataOffset) throw std::runtime_error("File " + path + " is truncated");
+
+		std::array<uint64_t, numDims> extents;
+		std::memcpy(extents.data(), static_cast<const char*>(file.data()) + sizeof(header), sizeof(extents));
+
+		// The product is checked against the elements in the file step by step, so it can't overflow
+		const size_t available = (file.size() - size_t(header.dataOffset)) / sizeof(ValueType);
+		vector_size<numDims> sizes;
+		size_t count = 1;
+		for(size_t i = 0; i < numDims; ++i)
+		{
+			if(uint64_t(size_t(extents[i])) != extents[i]) throw std::runtime_error("File " + path + " is damaged");
+			sizes[i] = size_t(extents[i]);
+			if(sizes[i] != 0 && count > available / sizes[i]) throw std::runtime_error("File " + path + " is truncated");
+			count *= sizes[i];
+		}
+
+		setup(sizes, size_t(header.dataOffset));
+	}
+
+	vector_n_mapped(const vector_n_mapped &) = delete;
+	vector_n_mapped &operator=(const vector_n_mapped &) = delete;
+
+	vector_n_mapped(vector_n_mapped &&other) noexcept
+		: Base(other), file(std::move(other.file))
+	{
+		other.Base::reset({}, {}, nullptr);
+	}
+
+	vector_n_mapped &operator=(vector_n_mapped &&other) noexcept
+	{
+		if(&other != this)
+		{
+			file = std::move(other.file);
+			*static_cast<Base*>(this) = static_cast<const Base&>(other);
+			other.Base::reset({}, {}, nullptr);
+		}
+		return *this;
+	}
+
+	// Creates (or overwrites) the file with zero-filled elements
+	template<typename ... Sizes>
+	static vector_n_mapped create(const std::string &path, Sizes ... sizes)
+	{
+		static_assert(!std::is_const_v<ElementType>, "Read-only file can't be created");
+		static_assert(sizeof...(sizes) == numDims, "Parameters count is invalid");
+		static_assert(impl::AllNumeric<Sizes...>::value, "Parameters type is invalid");
+
+		if(!impl::allPositive(sizes ...)) throw std::invalid_argument("All dimensions must be positive");
+
+		const vector_size<numDims> dims{size_t(sizes)...};
+		const std::array<uint64_t, numDims> extents{uint64_t(sizes)...};
+		// The data is aligned to the cache line
+		const size_t dataOffset = (headerSize() + 63) / 64 * 64;
+		size_t count = 1;
+		for(size_t size : dims)
+		{
+			if(size != 0 && count > (std::numeric_limits<size_t>::max() - dataOffset) / sizeof(ValueType) / size)
+				throw std::invalid_argument("Array is too large");
+			count *= size;
+		}
+
+		vector_n_mapped res;
+		res.file = impl::MappedFile(path, true, dataOffset + (count != 0 ? count : 1) * sizeof(ValueType));
+
+		impl::MappedHeader header;
+		std::memcpy(header.magic, impl::mappedMagic, sizeof(header.magic));
+		header.version = impl::mappedVersion;
+		header.rank = uint32_t(numDims);
+		header.elementSize = uint32_t(sizeof(ValueType));
+		header.elementKind = uint32_t(impl::element_kind<ValueType>());
+		header.dataOffset = dataOffset;
+
+		char *ptr = static_cast<char*>(res.file.data());
+		std::memcpy(ptr, &header, sizeof(header));
+		std::memcpy(ptr + sizeof(header), extents.data(), sizeof(extents));
+
+		res.setup(dims, dataOffset);
+		return res;
+	}
+
+	void advise(vector_n_advice advice) const
+	{
+		file.advise(advice);
+	}
+
+	// Writes all changes to the file
+	void flush() const
+	{
+		file.flush(file.data(), file.size());
+	}
+
+	void close()
+	{
+		file.close();
+		Base::reset({}, {}, nullptr);
+	}
+
+	bool is_open() const
+	{
+		return file.data() != nullptr;
+	}
+
+private:
+	impl::MappedFile file;
+
+	static constexpr size_t headerSize()
+	{
+		return sizeof(impl::MappedHeader) + numDims * sizeof(uint64_t);
+	}
+
+	void setup(const vector_size<numDims> &sizes, size_t dataOffset)
+	{
+		std::array<size_t, numDims + 1> coefs;
+		coefs[numDims] = 0;
+		impl::calcCoefficients<numDims>(coefs.data(), sizes.data());
+
+		Base::reset(coefs, sizes, reinterpret_cast<ElementType*>(static_cast<char*>(file.data()) + dataOffset));
+	}
+};
@@ -0,0 +1,306 @@
+#pragma once
+#include <cstddef>
+#include <type_traits>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define VECTOR_N_SIMD_X86
+#include <intrin.h>
+#include <immintrin.h>
+#define VECTOR_N_TARGET_AVX2
+#define VECTOR_N_TARGET_AVX512
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define VECTOR_N_SIMD_X86
+#include <immintrin.h>
+#define VECTOR_N_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define VECTOR_N_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+
+// Reduction kernels over contiguous and strided runs of elements.
+// float and double use AVX2 or AVX-512 if the processor supports them, other types
+// and other processors use the portable code with several accumulators
+namespace impl
+{
+	enum class ReduceOp { sum, min, max, dot };
+
+	enum class SimdLevel { none, avx2, avx512 };
+
+#ifdef VECTOR_N_SIMD_X86
+	inline SimdLevel detect_simd_level()
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if(info[0] < 7) return SimdLevel::none;
+
+		__cpuid(info, 1);
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool fma = (info[2] & (1 << 12)) != 0;
+		if(!osxsave) return SimdLevel::none;
+		const unsigned long long xcr0 = _xgetbv(0);
+
+		__cpuidex(info, 7, 0);
+		const bool avx2 = (info[1] & (1 << 5)) != 0;
+		const bool avx512 = (info[1] & (1 << 16)) != 0;
+
+		// The OS must save the upper halves of the registers
+		if(avx512 && (xcr0 & 0xe6) == 0xe6) return SimdLevel::avx512;
+		if(avx2 && fma && (xcr0 & 0x6) == 0x6) return SimdLevel::avx2;
+		return SimdLevel::none;
+#else
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx512f")) return SimdLevel::avx512;
+		if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return SimdLevel::avx2;
+		return SimdLevel::none;
+#endif
+	}
+#else
+	inline SimdLevel detect_simd_level()
+	{
+		return SimdLevel::none;
+	}
+#endif
+
+	inline SimdLevel simd_level()
+	{
+		static const SimdLevel level = detect_simd_level();
+		return level;
+	}
+
+	// min and max keep the accumulated value unless the element compares less (greater), so NaN
+	// elements are skipped, but a NaN accumulator stays. The vector kernels give the same results:
+	// minps(a, acc) and maxps(a, acc) return acc when either operand is NaN
+	template<ReduceOp Op, class T>
+	inline void reduce_step(T &acc, const T &a, const T &b)
+	{
+		if constexpr (Op == ReduceOp::sum) acc += a;
+		else if constexpr (Op == ReduceOp::dot) acc += a * b;
+		else if constexpr (Op == ReduceOp::min) { if(a < acc) acc = a; }
+		else { if(acc < a) acc = a; }
+	}
+
+	// Initial value of the accumulators, min and max start from the first element
+	template<ReduceOp Op, class T>
+	inline T reduce_init(const T *p)
+	{
+		if constexpr (Op == ReduceOp::sum || Op == ReduceOp::dot) return T();
+		else return *p;
+	}
+
+	// Portable kernel, n > 0. Four independent accumulators hide the latency of the additions
+	template<ReduceOp Op, class T>
+	inline T reduce_strided(const T *p, size_t pStride, const T *q, size_t qStride, size_t n)
+	{
+		T acc0 = reduce_init<Op>(p), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+
+		size_t i = 0;
+		for(; i + 4 <= n; i += 4)
+		{
+			reduce_step<Op>(acc0, p[i * pStride], q[i * qStride]);
+			reduce_step<Op>(acc1, p[(i + 1) * pStride], q[(i + 1) * qStride]);
+			reduce_step<Op>(acc2, p[(i + 2) * pStride], q[(i + 2) * qStride]);
+			reduce_step<Op>(acc3, p[(i + 3) * pStride], q[(i + 3) * qStride]);
+		}
+		for(; i != n; ++i) reduce_step<Op>(acc0, p[i * pStride], q[i * qStride]);
+
+		reduce_step<Op == ReduceOp::dot ? ReduceOp::sum : Op>(acc0, acc1, acc1);
+		reduce_step<Op == ReduceOp::dot ? ReduceOp::sum : Op>(acc2, acc3, acc3);
+		reduce_step<Op == ReduceOp::dot ? ReduceOp::sum : Op>(acc0, acc2, acc2);
+		return acc0;
+	}
+
+#ifdef VECTOR_N_SIMD_X86
+	template<class T> struct Avx2;
+
+	template<> struct Avx2<float>
+	{
+		typedef __m256 reg;
+		static const size_t width = 8;
+		VECTOR_N_TARGET_AVX2 static inline reg set1(float x) { return _mm256_set1_ps(x); }
+		VECTOR_N_TARGET_AVX2 static inline reg load(const float *p) { return _mm256_loadu_ps(p); }
+		VECTOR_N_TARGET_AVX2 static inline void store(float *p, reg r) { _mm256_storeu_ps(p, r); }
+		VECTOR_N_TARGET_AVX2 static inline reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+		VECTOR_N_TARGET_AVX2 static inline reg fmadd(reg a, reg b, reg c) { return _mm256_fmadd_ps(a, b, c); }
+		VECTOR_N_TARGET_AVX2 static inline reg min(reg a, reg b) { return _mm256_min_ps(a, b); }
+		VECTOR_N_TARGET_AVX2 static inline reg max(reg a, reg b) { return _mm256_max_ps(a, b); }
+
+		template<ReduceOp Op>
+		VECTOR_N_TARGET_AVX2 static inline reg step(reg acc, const float *p, const float *q)
+		{
+			if constexpr (Op == ReduceOp::sum) return add(acc, load(p));
+			else if constexpr (Op == ReduceOp::dot) return fmadd(load(p), load(q), acc);
+			else if constexpr (Op == ReduceOp::min) return min(load(p), acc);
+			else return max(load(p), acc);
+		}
+
+		template<ReduceOp Op>
+		VECTOR_N_TARGET_AVX2 static inline reg combine(reg a, reg b)
+		{
+			if constexpr (Op == ReduceOp::min) return min(b, a);
+			else if constexpr (Op == ReduceOp::max) return max(b, a);
+			else return add(a, b);
+		}
+	};
+
+	template<> struct Avx2<double>
+	{
+		typedef __m256d reg;
+		static const size_t width = 4;
+		VECTOR_N_TARGET_AVX2 static inline reg set1(double x) { return _mm256_set1_pd(x); }
+		VECTOR_N_TARGET_AVX2 static inline reg load(const double *p) { return _mm256_loadu_pd(p); }
+		VECTOR_N_TARGET_AVX2 static inline void store(double *p, reg r) { _mm256_storeu_pd(p, r); }
+		VECTOR_N_TARGET_AVX2 static inline reg add(reg a, reg b) { return _mm256_add_pd(a, b); }
+		VECTOR_N_TARGET_AVX2 static inline reg fmadd(reg a, reg b, reg c) { return _mm256_fmadd_pd(a, b, c); }
+		VECTOR_N_TARGET_AVX2 static inline reg min(reg a, reg b) { return _mm256_min_pd(a, b); }
+		VECTOR_N_TARGET_AVX2 static inline reg max(reg a, reg b) { return _mm256_max_pd(a, b); }
+
+		template<ReduceOp Op>
+		VECTOR_N_TARGET_AVX2 static inline reg step(reg acc, const double *p, const double *q)
+		{
+			if constexpr (Op == ReduceOp::sum) return add(acc, load(p));
+			else if constexpr (Op == ReduceOp::dot) return fmadd(load(p), load(q), acc);
+			else if constexpr (Op == ReduceOp::min) return min(load(p), acc);
+			else return max(load(p), acc);
+		}
+
+		template<ReduceOp Op>
+		VECTOR_N_TARGET_AVX2 static inline reg combine(reg a, reg b)
+		{
+			if constexpr (Op == ReduceOp::min) return min(b, a);
+			else if constexpr (Op == ReduceOp::max) return max(b, a);
+			else return add(a, b);
+		}
+	};
+
+	template<class T> struct Avx512;
+
+	// min and max are masked, because the unmasked forms produce false warnings in some GCC versions
+	template<> struct Avx512<float>
+	{
+		typedef __m512 reg;
+		static const size_t width = 16;
+		VECTOR_N_TARGET_AVX512 static inline reg set1(float x) { return _mm512_set1_ps(x); }
+		VECTOR_N_TARGET_AVX512 static inline reg load(const float *p) { return _mm512_loadu_ps(p); }
+		VECTOR_N_TARGET_AVX512 static inline void store(float *p, reg r) { _mm512_storeu_ps(p, r); }
+		VECTOR_N_TARGET_AVX512 static inline reg add(reg a, reg b) { return _mm512_add_ps(a, b); }
+		VECTOR_N_TARGET_AVX512 static inline reg fmadd(reg a, reg b, reg c) { return _mm512_fmadd_ps(a, b, c); }
+		VECTOR_N_TARGET_AVX512 static inline reg min(reg a, reg b) { return _mm512_mask_min_ps(a, __mmask16(-1), a, b); }
+		VECTOR_N_TARGET_AVX512 static inline reg max(reg a, reg b) { return _mm512_mask_max_ps(a, __mmask16(-1), a, b); }
+
+		template<ReduceOp Op>
+		VECTOR_N_TARGET_AVX512 static inline reg step(reg acc, const float *p, const float *q)
+		{
+			if constexpr (Op == ReduceOp::sum) return add(acc, load(p));
+			else if constexpr (Op == ReduceOp::dot) return fmadd(load(p), load(q), acc);
+			else if constexpr (Op == ReduceOp::min) return min(load(p), acc);
+			else return max(load(p), acc);
+		}
+
+		template<ReduceOp Op>
+		VECTOR_N_TARGET_AVX512 static inline reg combine(reg a, reg b)
+		{
+			if constexpr (Op == ReduceOp::min) return min(b, a);
+			else if constexpr (Op == ReduceOp::max) return max(b, a);
+			else return add(a, b);
+		}
+	};
+
+	template<> struct Avx512<double>
+	{
+		typedef __m512d reg;
+		static const size_t width = 8;
+		VECTOR_N_TARGET_AVX512 static inline reg set1(double x) { return _mm512_set1_pd(x); }
+		VECTOR_N_TARGET_AVX512 static inline reg load(const double *p) { return _mm512_loadu_pd(p); }
+		VECTOR_N_TARGET_AVX512 static inline void store(double *p, reg r) { _mm512_storeu_pd(p, r); }
+		VECTOR_N_TARGET_AVX512 static inline reg add(reg a, reg b) { return _mm512_add_pd(a, b); }
+		VECTOR_N_TARGET_AVX512 static inline reg fmadd(reg a, reg b, reg c) { return _mm512_fmadd_pd(a, b, c); }
+		VECTOR_N_TARGET_AVX512 static inline reg min(reg a, reg b) { return _mm512_mask_min_pd(a, __mmask8(-1), a, b); }
+		VECTOR_N_TARGET_AVX512 static inline reg max(reg a, reg b) { return _mm512_mask_max_pd(a, __mmask8(-1), a, b); }
+
+		template<ReduceOp Op>
+		VECTOR_N_TARGET_AVX512 static inline reg step(reg acc, const double *p, const double *q)
+		{
+			if constexpr (Op == ReduceOp::sum) return add(acc, load(p));
+			else if constexpr (Op == ReduceOp::dot) return fmadd(load(p), load(q), acc);
+			else if constexpr (Op == ReduceOp::min) return min(load(p), acc);
+			else return max(load(p), acc);
+		}
+
+		template<ReduceOp Op>
+		VECTOR_N_TARGET_AVX512 static inline reg combine(reg a, reg b)
+		{
+			if constexpr (Op == ReduceOp::min) return min(b, a);
+			else if constexpr (Op == ReduceOp::max) return max(b, a);
+			else return add(a, b);
+		}
+	};
+
+	// The kernels for AVX2 and AVX-512 differ only in the set of instructions V, but each of them
+	// needs its own target for the compiler, so the instructions are inlined. n >= 4 * V::width
+	template<ReduceOp Op, class T>
+	VECTOR_N_TARGET_AVX2 T reduce_avx2(const T *p, const T *q, size_t n)
+	{
+		typedef Avx2<T> V;
+		const size_t w = V::width;
+		typename V::reg acc0 = V::set1(reduce_init<Op>(p)), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+
+		size_t i = 0;
+		for(; i + 4 * w <= n; i += 4 * w)
+		{
+			acc0 = V::template step<Op>(acc0, p + i, q + i);
+			acc1 = V::template step<Op>(acc1, p + i + w, q + i + w);
+			acc2 = V::template step<Op>(acc2, p + i + 2 * w, q + i + 2 * w);
+			acc3 = V::template step<Op>(acc3, p + i + 3 * w, q + i + 3 * w);
+		}
+		for(; i + w <= n; i += w) acc0 = V::template step<Op>(acc0, p + i, q + i);
+		acc0 = V::template combine<Op>(V::template combine<Op>(acc0, acc1), V::template combine<Op>(acc2, acc3));
+
+		T lanes[w];
+		V::store(lanes, acc0);
+		T res = lanes[0];
+		for(size_t j = 1; j != w; ++j) reduce_step<Op == ReduceOp::dot ? ReduceOp::sum : Op>(res, lanes[j], lanes[j]);
+		for(; i != n; ++i) reduce_step<Op>(res, p[i], q[i]);
+		return res;
+	}
+
+	template<ReduceOp Op, class T>
+	VECTOR_N_TARGET_AVX512 T reduce_avx512(const T *p, const T *q, size_t n)
+	{
+		typedef Avx512<T> V;
+		const size_t w = V::width;
+		typename V::reg acc0 = V::set1(reduce_init<Op>(p)), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+
+		size_t i = 0;
+		for(; i + 4 * w <= n; i += 4 * w)
+		{
+			acc0 = V::template step<Op>(acc0, p + i, q + i);
+			acc1 = V::template step<Op>(acc1, p + i + w, q + i + w);
+			acc2 = V::template step<Op>(acc2, p + i + 2 * w, q + i + 2 * w);
+			acc3 = V::template step<Op>(acc3, p + i + 3 * w, q + i + 3 * w);
+		}
+		for(; i + w <= n; i += w) acc0 = V::template step<Op>(acc0, p + i, q + i);
+		acc0 = V::template combine<Op>(V::template combine<Op>(acc0, acc1), V::template combine<Op>(acc2, acc3));
+
+		T lanes[w];
+		V::store(lanes, acc0);
+		T res = lanes[0];
+		for(size_t j = 1; j != w; ++j) reduce_step<Op == ReduceOp::dot ? ReduceOp::sum : Op>(res, lanes[j], lanes[j]);
+		for(; i != n; ++i) reduce_step<Op>(res, p[i], q[i]);
+		return res;
+	}
+#endif
+
+	// Reduction of n > 0 contiguous elements. q is used only by ReduceOp::dot
+	template<ReduceOp Op, class T>
+	inline T reduce_contiguous(const T *p, const T *q, size_t n)
+	{
+#ifdef VECTOR_N_SIMD_X86
+		if constexpr (std::is_same_v<T, float> || std::is_same_v<T, double>)
+		{
+			const SimdLevel level = simd_level();
+			if(level == SimdLevel::avx512 && n >= 4 * Avx512<T>::width) return reduce_avx512<Op>(p, q, n);
+			if(level != SimdLevel::none && n >= 4 * Avx2<T>::width) return reduce_avx2<Op>(p, q, n);
+		}
+#endif
+		return reduce_strided<Op>(p, 1, q, 1, n);
+	}
+}
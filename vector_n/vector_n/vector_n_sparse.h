@@ -0,0 +1,538 @@
+#pragma once
+#include "vector_n.h"
+#include "vector_n_tiled.h"
+
+namespace impl
+{
+	// Bricks of B^N elements (row-major inside), a brick is allocated on the first write,
+	// the missing ones read as the background value
+	template<class T, size_t N, size_t B>
+	class SparseBricks
+	{
+	public:
+		static constexpr int rank = int(N);
+
+		static constexpr size_t brickVolume()
+		{
+			size_t res = 1;
+			for(size_t i = 0; i != N; ++i) res *= B;
+			return res;
+		}
+
+		SparseBricks() : grid{}, sizes{}, background()
+		{
+		}
+
+		SparseBricks(const SparseBricks &other)
+			: grid(other.grid), sizes(other.sizes), bricks(other.bricks.size()), allocated(other.allocated), background(other.background)
+		{
+			for(size_t i = 0; i != bricks.size(); ++i)
+			{
+				if(!other.bricks[i]) continue;
+				bricks[i].reset(new T[brickVolume()]);
+				std::copy(other.bricks[i].get(), other.bricks[i].get() + brickVolume(), bricks[i].get());
+			}
+		}
+
+		SparseBricks(SparseBricks &&other) noexcept
+			: grid(other.grid), sizes(other.sizes), bricks(std::move(other.bricks)), allocated(other.allocated), background(std::move(other.background))
+		{
+			other.grid = {};
+			other.sizes = {};
+			other.allocated = 0;
+		}
+
+		SparseBricks &operator=(SparseBricks other) noexcept
+		{
+			swap(other);
+			return *this;
+		}
+
+		void swap(SparseBricks &other) noexcept
+		{
+			std::swap(grid, other.grid);
+			std::swap(sizes, other.sizes);
+			bricks.swap(other.bricks);
+			std::swap(allocated, other.allocated);
+			std::swap(background, other.background);
+		}
+
+		// All bricks are released
+		void resize(const std::array<size_t, N> &asizes)
+		{
+			size_t count = 1;
+			for(size_t i = 0; i != N; ++i)
+			{
+				grid[i] = (asizes[i] + B - 1) / B;
+				count *= grid[i];
+			}
+			std::vector<std::unique_ptr<T[]>>(count).swap(bricks);
+			sizes = asizes;
+			allocated = 0;
+		}
+
+		// The element for writing, its brick is allocated if needed
+		inline T &ref(const std::array<size_t, N> &pos)
+		{
+			std::unique_ptr<T[]> &brick = bricks[brickIndex(pos)];
+			if(!brick) allocate(brick);
+			return brick[innerIndex(pos)];
+		}
+
+		inline const T &get(const std::array<size_t, N> &pos) const
+		{
+			const std::unique_ptr<T[]> &brick = bricks[brickIndex(pos)];
+			return brick ? brick[innerIndex(pos)] : background;
+		}
+
+		inline size_t brickIndex(const std::array<size_t, N> &pos) const
+		{
+			size_t res = 0;
+			for(size_t i = 0; i != N; ++i) res = res * grid[i] + pos[i] / B;
+			return res;
+		}
+
+		static inline size_t innerIndex(const std::array<size_t, N> &pos)
+		{
+			size_t res = 0;
+			for(size_t i = 0; i != N; ++i) res = res * B + pos[i] % B;
+			return res;
+		}
+
+		// Box of the indexes [from, to) of the brick, cut by the sizes
+		void brickBox(size_t index, std::array<size_t, N> &from, std::array<size_t, N> &to) const
+		{
+			for(size_t i = N; i-- > 0;)
+			{
+				from[i] = index % grid[i] * B;
+				to[i] = std::min(from[i] + B, sizes[i]);
+				index /= grid[i];
+			}
+		}
+
+		void allocate(std::unique_ptr<T[]> &brick)
+		{
+			brick.reset(new T[brickVolume()]);
+			std::fill(brick.get(), brick.get() + brickVolume(), background);
+			++allocated;
+		}
+
+		void release(size_t index)
+		{
+			if(!bricks[index]) return;
+			bricks[index].reset();
+			--allocated;
+		}
+
+		std::array<size_t, N> grid;
+		std::array<size_t, N> sizes;
+		std::vector<std::unique_ptr<T[]>> bricks;
+		size_t allocated = 0;
+		T background;
+	};
+
+	// Element of a lazily allocated array: reading goes through get(pos), so it doesn't allocate,
+	// only the assignments go through ref(pos)
+	template<class T, class Storage>
+	class LazyReference
+	{
+	public:
+		LazyReference(Storage *astorage, const std::array<size_t, Storage::rank> &apos) : storage(astorage), pos(apos)
+		{
+		}
+
+		inline operator const T &() const
+		{
+			return storage->get(pos);
+		}
+
+		inline const T &get() const
+		{
+			return storage->get(pos);
+		}
+
+		// Assigns the value, not the reference
+		inline LazyReference &operator=(const LazyReference &other)
+		{
+			return *this = other.get();
+		}
+
+		inline LazyReference &operator=(const T &value)
+		{
+			storage->ref(pos) = value;
+			return *this;
+		}
+
+		inline LazyReference &operator+=(const T &value)
+		{
+			storage->ref(pos) += value;
+			return *this;
+		}
+
+		inline LazyReference &operator-=(const T &value)
+		{
+			storage->ref(pos) -= value;
+			return *this;
+		}
+
+		inline LazyReference &operator*=(const T &value)
+		{
+			storage->ref(pos) *= value;
+			return *this;
+		}
+
+		inline LazyReference &operator/=(const T &value)
+		{
+			storage->ref(pos) /= value;
+			return *this;
+		}
+
+	private:
+		Storage *storage;
+		std::array<size_t, Storage::rank> pos;
+	};
+
+	// Slice of an array which allocates its parts lazily: the fixed coordinates and the dimensions
+	// of the storage which are left. The elements are reached through the storage: ref(pos) for
+	// writing (it allocates the part), get(pos) for reading. The mutable slice returns LazyReference,
+	// so the part is allocated only when the element is assigned
+	template<class ElementType, int numDims, class Storage>
+	class SparseSlice
+	{
+		template<class T, int N, class S>
+		friend class SparseSlice;
+
+		static constexpr int storageRank = Storage::rank;
+		typedef std::conditional_t<std::is_const_v<ElementType>, const Storage, Storage> StorageType;
+	public:
+		typedef std::conditional_t<std::is_const_v<ElementType>, ElementType &, LazyReference<ElementType, Storage>> reference;
+
+		SparseSlice() : storage(nullptr), base{}, dims{}, sizes{}
+		{
+		}
+
+		// Constant slice of the same elements
+		operator SparseSlice<const ElementType, numDims, Storage>() const
+		{
+			SparseSlice<const ElementType, numDims, Storage> res;
+			res.storage = storage;
+			res.base = base;
+			res.dims = dims;
+			res.sizes = sizes;
+			return res;
+		}
+
+		template<typename ... Indexes>
+		inline reference operator()(Indexes ... indexes)
+		{
+			static_assert(impl::AllNumeric<Indexes...>::value, "Parameters type is invalid");
+			static_assert(sizeof...(indexes) == numDims, "Parameters count is invalid");
+			assert(impl::checkIndex(sizes.data(), indexes...) && "Indexes is invalid.");
+
+			if constexpr(std::is_const_v<ElementType>) return storage->get(position(indexes...));
+			else return reference(storage, position(indexes...));
+		}
+
+		template<typename ... Indexes>
+		inline const ElementType &operator()(Indexes ... indexes) const
+		{
+			static_assert(impl::AllNumeric<Indexes...>::value, "Parameters type is invalid");
+			static_assert(sizeof...(indexes) == numDims, "Parameters count is invalid");
+			assert(impl::checkIndex(sizes.data(), indexes...) && "Indexes is invalid.");
+
+			return storage->get(position(indexes...));
+		}
+
+		template<typename ... Indexes>
+		inline reference at(Indexes ... indexes)
+		{
+			if(!impl::checkIndex(sizes.data(), indexes...)) throw std::out_of_range("One or more indexes are invalid");
+			return (*this)(indexes...);
+		}
+
+		template<typename ... Indexes>
+		inline const ElementType &at(Indexes ... indexes) const
+		{
+			if(!impl::checkIndex(sizes.data(), indexes...)) throw std::out_of_range("One or more indexes are invalid");
+			return (*this)(indexes...);
+		}
+
+		inline size_t size(const int numberDims) const
+		{
+			assert((numberDims - 1) < numDims && (numberDims - 1) >= 0 && "Parameters count is invalid");
+
+			return sizes[numberDims - 1];
+		}
+
+		inline const vector_size<numDims> &size() const
+		{
+			return sizes;
+		}
+
+		// Value of the elements which were never written
+		inline const std::remove_const_t<ElementType> &background() const
+		{
+			return storage->background;
+		}
+
+		template<int...Indexes, class ...Args>
+		SparseSlice<ElementType, numDims - sizeof...(Indexes), Storage> fix(Args ...c_index)
+		{
+			return fix_impl<ElementType, Indexes...>(c_index...);
+		}
+
+		// The elements of the constant slice are constant
+		template<int...Indexes, class ...Args>
+		SparseSlice<const ElementType, numDims - sizeof...(Indexes), Storage> fix(Args ...c_index) const
+		{
+			return fix_impl<const ElementType, Indexes...>(c_index...);
+		}
+
+	protected:
+		void reset(Storage *astorage)
+		{
+			storage = astorage;
+			base = {};
+			for(int i = 0; i != numDims; ++i) dims[i] = i;
+			sizes = astorage->sizes;
+		}
+
+		StorageType *storage;
+		// Coordinates in the storage, the fixed ones are set
+		std::array<size_t, storageRank> base;
+		// Dimension of the storage for every dimension of the slice
+		std::array<int, numDims> dims;
+		vector_size<numDims> sizes;
+
+	private:
+		template<class T, int...Indexes, class ...Args>
+		SparseSlice<T, numDims - sizeof...(Indexes), Storage> fix_impl(Args ...c_index) const
+		{
+			const int new_dim = numDims - sizeof...(Indexes);
+			static_assert(sizeof...(Indexes) == sizeof...(Args), "Indexes and template parameters count do not match");
+			static_assert(valid_index_set<numDims, Indexes...>, "Invalid index set");
+			static_assert(AllNumeric<Args...>::value, "Invalid arguments");
+
+			std::array<size_t, sizeof...(Indexes)> template_index{Indexes...};
+			std::array<size_t, sizeof...(Indexes)> args{size_t(c_index)...};
+
+			SparseSlice<T, new_dim, Storage> res;
+			res.storage = storage;
+			res.base = base;
+			for(int i = 0, j = 0; i < numDims; ++i)
+			{
+				if(!has_v_fun<Indexes...>(i))
+				{
+					res.sizes[j] = sizes[i];
+					res.dims[j] = dims[i];
+					++j;
+				}
+			}
+			for(size_t i = 0; i != sizeof...(Indexes); ++i)
+			{
+				if(args[i] >= sizes[template_index[i]]) throw std::invalid_argument("One or more index too large");
+				res.base[dims[template_index[i]]] = args[i];
+			}
+			return res;
+		}
+
+		template<typename ... Indexes>
+		inline std::array<size_t, storageRank> position(Indexes ... indexes) const
+		{
+			std::array<size_t, storageRank> res = base;
+			int d = 0;
+			((res[dims[d++]] = size_t(indexes)), ...);
+			return res;
+		}
+	};
+}
+
+// Block-sparse array for grids which are mostly the background value: the elements are
+// stored in bricks of BrickSize^numDims, a brick is allocated when any of its elements is
+// assigned, the elements of the missing bricks read as background(). operator() and at of
+// a non-const array or slice return a proxy, so reading through them doesn't allocate either.
+// Concurrent writes are safe only into the bricks which are already allocated
+template<class ElementType, size_t numDims, size_t BrickSize = vector_n_brick_size<numDims>>
+class vector_n_sparse : public impl::SparseSlice<ElementType, int(numDims), impl::SparseBricks<ElementType, numDims, BrickSize>>
+{
+	typedef impl::SparseBricks<ElementType, numDims, BrickSize> Storage;
+	typedef impl::SparseSlice<ElementType, int(numDims), Storage> Base;
+	static_assert(BrickSize != 0, "Brick size must be positive");
+public:
+	static constexpr size_t brick_size = BrickSize;
+
+	vector_n_sparse()
+	{
+		Base::reset(&bricks);
+	}
+
+	template<typename ... Sizes, class = std::enable_if_t<impl::AllNumeric<Sizes...>::value>>
+	vector_n_sparse(Sizes ... sizes)
+	{
+		static_assert(sizeof...(sizes) == numDims, "Parameters count is invalid");
+
+		if(!impl::allPositive(sizes ...)) throw std::invalid_argument("All dimensions must be positive");
+
+		resize(vector_size<numDims>{size_t(sizes)...});
+	}
+
+	vector_n_sparse(const vector_size<numDims> &sizes, const ElementType &background)
+	{
+		bricks.background = background;
+		resize(sizes);
+	}
+
+	vector_n_sparse(const vector_n_sparse &other) : bricks(other.bricks)
+	{
+		Base::reset(&bricks);
+	}
+
+	vector_n_sparse(vector_n_sparse &&other) noexcept : bricks(std::move(other.bricks))
+	{
+		Base::reset(&bricks);
+		other.Base::reset(&other.bricks);
+	}
+
+	vector_n_sparse &operator=(const vector_n_sparse &other)
+	{
+		if(&other != this) vector_n_sparse(other).swap(*this);
+		return *this;
+	}
+
+	vector_n_sparse &operator=(vector_n_sparse &&other) noexcept
+	{
+		if(&other != this) vector_n_sparse(std::move(other)).swap(*this);
+		return *this;
+	}
+
+	void swap(vector_n_sparse &other) noexcept
+	{
+		bricks.swap(other.bricks);
+		Base::reset(&bricks);
+		other.Base::reset(&other.bricks);
+	}
+
+	// The contents are lost
+	void resize(const vector_size<numDims> &sizes)
+	{
+		bricks.resize(sizes);
+		Base::reset(&bricks);
+	}
+
+	template<typename ... Sizes, class = std::enable_if_t<impl::AllNumeric<Sizes...>::value>>
+	void resize(Sizes ... sizes)
+	{
+		resize(vector_size<numDims>{size_t(sizes)...});
+	}
+
+	// Changes the value of all elements of the missing bricks, the allocated ones keep their values
+	void set_background(const ElementType &value)
+	{
+		bricks.background = value;
+	}
+
+	// Releases the bricks where every element equals the background
+	void prune()
+	{
+		for(size_t i = 0; i != bricks.bricks.size(); ++i)
+		{
+			const ElementType *brick = bricks.bricks[i].get();
+			if(brick != nullptr && std::all_of(brick, brick + Storage::brickVolume(), [this](const ElementType &x) { return x == bricks.background; }))
+				bricks.release(i);
+		}
+	}
+
+	// Number of the bricks along every dimension
+	const vector_size<numDims> &brick_count() const
+	{
+		return bricks.grid;
+	}
+
+	size_t allocated_bricks() const
+	{
+		return bricks.allocated;
+	}
+
+	// Bytes taken by the array: the bricks and the brick directory
+	size_t memory_bytes() const
+	{
+		return sizeof(*this) + bricks.bricks.capacity() * sizeof(bricks.bricks[0]) +
+			bricks.allocated * Storage::brickVolume() * sizeof(ElementType);
+	}
+
+	// Bytes the same array would take in vector_n
+	size_t dense_bytes() const
+	{
+		size_t res = sizeof(ElementType);
+		for(size_t size : Base::sizes) res *= size;
+		return res;
+	}
+
+	// Calls f(from, to) for every allocated brick with the box of indexes [from, to) it holds
+	template<class Function>
+	void for_each_brick(Function f) const
+	{
+		vector_size<numDims> from, to;
+		for(size_t i = 0; i != bricks.bricks.size(); ++i)
+		{
+			if(!bricks.bricks[i]) continue;
+			bricks.brickBox(i, from, to);
+			f(static_cast<const vector_size<numDims>&>(from), static_cast<const vector_size<numDims>&>(to));
+		}
+	}
+
+	// Calls f for every element of the allocated bricks brick by brick, the last dimension is the innermost
+	template<class Function>
+	void for_each(Function f)
+	{
+		for_each_impl<ElementType>(f);
+	}
+
+	template<class Function>
+	void for_each(Function f) const
+	{
+		for_each_impl<const ElementType>(f);
+	}
+
+private:
+	Storage bricks;
+
+	template<class T, class Function>
+	void for_each_impl(Function &f) const
+	{
+		for_each_brick([&](const vector_size<numDims> &from, const vector_size<numDims> &to)
+		{
+			T *brick = bricks.bricks[bricks.brickIndex(from)].get();
+			bool full = true;
+			for(size_t i = 0; i != numDims; ++i) full = full && to[i] - from[i] == BrickSize;
+
+			if(full)
+			{
+				for(size_t i = 0; i != Storage::brickVolume(); ++i) f(brick[i]);
+				return;
+			}
+
+			// The border brick: only the rows inside the array
+			vector_size<numDims> pos = from;
+			while(true)
+			{
+				T *row = brick + Storage::innerIndex(pos);
+				for(size_t i = 0; i != to[numDims - 1] - from[numDims - 1]; ++i) f(row[i]);
+
+				int d = int(numDims) - 2;
+				for(; d >= 0; --d)
+				{
+					if(++pos[d] != to[d]) break;
+					pos[d] = from[d];
+				}
+				if(d < 0) return;
+			}
+		});
+	}
+};
+
+template<class ElementType, size_t numDims, size_t BrickSize>
+inline void swap(vector_n_sparse<ElementType, numDims, BrickSize> &a, vector_n_sparse<ElementType, numDims, BrickSize> &b) noexcept
+{
+	a.swap(b);
+}
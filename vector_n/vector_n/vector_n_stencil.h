@@ -0,0 +1,306 @@
+#pragma once
+#include "vector_n.h"
+
+// What the neighbours outside of the array are
+enum class vector_n_boundary
+{
+	// The nearest element of the array
+	clamp,
+	// The array is repeated in every dimension
+	periodic,
+	// The given value
+	constant,
+	// The cells closer to the border than the radius are not written at all
+	skip
+};
+
+namespace impl
+{
+	// Neighbourhood of a cell which is at least Radius far from the borders, the neighbours are
+	// read directly. get<offsets...>() is the neighbour at the compile-time offsets,
+	// operator()(offsets...) is the same for the runtime ones
+	template<class T, int N, int Radius>
+	class InteriorNeighbourhood
+	{
+	public:
+		typedef std::remove_const_t<T> value_type;
+
+		InteriorNeighbourhood(const std::array<size_t, N> &strides) : m_center(nullptr), m_strides(strides) {}
+
+		template<int ...Offsets>
+		inline value_type get() const
+		{
+			static_assert(sizeof...(Offsets) == N, "Offsets count is invalid");
+			static_assert(((Offsets <= Radius && -Offsets <= Radius) && ...), "Offset is larger than the radius");
+			return (*this)(Offsets...);
+		}
+
+		template<class ...Offsets>
+		inline value_type operator()(Offsets ... offsets) const
+		{
+			static_assert(sizeof...(Offsets) == N, "Offsets count is invalid");
+			assert(((ptrdiff_t(offsets) <= Radius && -ptrdiff_t(offsets) <= Radius) && ...) && "Offset is larger than the radius");
+			ptrdiff_t offset = 0;
+			int d = 0;
+			((offset += ptrdiff_t(offsets) * ptrdiff_t(m_strides[d++])), ...);
+			return m_center[offset];
+		}
+
+		void set_center(const value_type *center) { m_center = center; }
+
+	private:
+		const value_type *m_center;
+		std::array<size_t, N> m_strides;
+	};
+
+	// Neighbourhood of a cell near the border, the coordinates of every neighbour are mapped
+	// by the boundary policy
+	template<class T, int N, int Radius>
+	class BoundaryNeighbourhood
+	{
+	public:
+		typedef std::remove_const_t<T> value_type;
+
+		BoundaryNeighbourhood(const value_type *origin, const std::array<size_t, N> &sizes, const std::array<size_t, N> &strides,
+			vector_n_boundary boundary, const value_type &constant)
+			: m_origin(origin), m_sizes(sizes), m_strides(strides), m_boundary(boundary), m_constant(constant), m_pos{}
+		{
+		}
+
+		template<int ...Offsets>
+		inline value_type get() const
+		{
+			static_assert(sizeof...(Offsets) == N, "Offsets count is invalid");
+			static_assert(((Offsets <= Radius && -Offsets <= Radius) && ...), "Offset is larger than the radius");
+			return (*this)(Offsets...);
+		}
+
+		template<class ...Offsets>
+		value_type operator()(Offsets ... offsets) const
+		{
+			static_assert(sizeof...(Offsets) == N, "Offsets count is invalid");
+			assert(((ptrdiff_t(offsets) <= Radius && -ptrdiff_t(offsets) <= Radius) && ...) && "Offset is larger than the radius");
+			const std::array<ptrdiff_t, N> delta{ptrdiff_t(offsets)...};
+
+			size_t offset = 0;
+			for(int d = 0; d != N; ++d)
+			{
+				const ptrdiff_t size = ptrdiff_t(m_sizes[d]);
+				ptrdiff_t c = ptrdiff_t(m_pos[d]) + delta[d];
+				if(c < 0 || c >= size)
+				{
+					switch(m_boundary)
+					{
+					case vector_n_boundary::clamp: c = c < 0 ? 0 : size - 1; break;
+					case vector_n_boundary::periodic: c = (c % size + size) % size; break;
+					default: return m_constant;
+					}
+				}
+				offset += size_t(c) * m_strides[d];
+			}
+			return m_origin[offset];
+		}
+
+		void set_position(const std::array<size_t, N> &pos) { m_pos = pos; }
+
+	private:
+		const value_type *m_origin;
+		std::array<size_t, N> m_sizes;
+		std::array<size_t, N> m_strides;
+		vector_n_boundary m_boundary;
+		value_type m_constant;
+		std::array<size_t, N> m_pos;
+	};
+
+	// Edge of the interior tiles along the outer dimensions, the innermost one isn't split
+	// (except for 1D), so a tile with its halo stays in L2
+	constexpr size_t stencilTile = 16;
+	constexpr size_t stencilTile1d = 4096;
+}
+
+// Writes kernel(neighbourhood) to every cell of dst, the neighbourhood is centred at the same cell
+// of src. The kernel must be generic: the interior cells and the cells near the border (closer
+// than Radius) get different neighbourhood types, both have get<offsets...>() and operator()(offsets...).
+// The interior is split into tiles, which are processed by numThreads threads (all available if 0),
+// so the kernel is called concurrently and must not change any shared state without synchronization.
+// src and dst must have the same sizes and must not overlap
+template<int Radius, class T, class U, int N, class Kernel>
+void apply_stencil(const impl::VectorSlice<T, N> &src, const impl::VectorSlice<U, N> &dst, Kernel kernel,
+	vector_n_boundary boundary = vector_n_boundary::clamp, const std::remove_const_t<T> &constant = std::remove_const_t<T>(),
+	unsigned numThreads = 0)
+{
+	static_assert(Radius >= 0, "Radius must not be negative");
+	static_assert(!std::is_const_v<U>, "Destination must be writable");
+	typedef std::remove_const_t<T> V;
+
+	const vector_size<N> &sizes = src.size();
+	if(sizes != dst.size()) throw std::invalid_argument("Sizes of the operands differ");
+
+	const V *in = src.origin();
+	U *out = dst.origin();
+	const vector_size<N> inStrides = src.strides(), outStrides = dst.strides();
+
+	// Interior [lo, hi) along every dimension
+	vector_size<N> lo, hi;
+	bool hasInterior = true;
+	for(int d = 0; d != N; ++d)
+	{
+		lo[d] = std::min(sizes[d], size_t(Radius));
+		hi[d] = sizes[d] > 2 * size_t(Radius) ? sizes[d] - Radius : lo[d];
+		hasInterior = hasInterior && lo[d] < hi[d];
+	}
+
+	if(hasInterior)
+	{
+		vector_size<N> tileEdge, tileCount;
+		size_t tiles = 1;
+		for(int d = 0; d != N; ++d)
+		{
+			tileEdge[d] = d != N - 1 ? impl::stencilTile : (N == 1 ? impl::stencilTile1d : hi[d] - lo[d]);
+			tileCount[d] = (hi[d] - lo[d] + tileEdge[d] - 1) / tileEdge[d];
+			tiles *= tileCount[d];
+		}
+
+		impl::parallel_for_range(tiles, numThreads, [&](size_t begin, size_t end)
+		{
+			impl::InteriorNeighbourhood<T, N, Radius> neighbourhood(inStrides);
+			for(size_t t = begin; t != end; ++t)
+			{
+				vector_size<N> from, to;
+				size_t n = t;
+				for(int d = N - 1; d >= 0; --d)
+				{
+					from[d] = lo[d] + n % tileCount[d] * tileEdge[d];
+					to[d] = std::min(from[d] + tileEdge[d], hi[d]);
+					n /= tileCount[d];
+				}
+
+				// Rows of the tile along the innermost dimension
+				vector_size<N> pos = from;
+				while(true)
+				{
+					const V *inRow = in;
+					U *outRow = out;
+					for(int d = 0; d != N; ++d)
+					{
+						inRow += pos[d] * inStrides[d];
+						outRow += pos[d] * outStrides[d];
+					}
+					const size_t length = to[N - 1] - from[N - 1];
+					for(size_t i = 0; i != length; ++i)
+					{
+						neighbourhood.set_center(inRow + i * inStrides[N - 1]);
+						outRow[i * outStrides[N - 1]] = kernel(static_cast<const impl::InteriorNeighbourhood<T, N, Radius>&>(neighbourhood));
+					}
+
+					int d = N - 2;
+					for(; d >= 0; --d)
+					{
+						if(++pos[d] != to[d]) break;
+						pos[d] = from[d];
+					}
+					if(d < 0) break;
+				}
+			}
+		});
+	}
+
+	if(boundary == vector_n_boundary::skip || Radius == 0) return;
+
+	// Cells near the border: whole rows of the outer band and the ends of the other rows
+	size_t rows = 1;
+	for(int d = 0; d + 1 < N; ++d) rows *= sizes[d];
+	if(rows == 0 || sizes[N - 1] == 0) return;
+
+	impl::parallel_for_range(rows, numThreads, [&](size_t begin, size_t end)
+	{
+		impl::BoundaryNeighbourhood<T, N, Radius> neighbourhood(in, sizes, inStrides, boundary, constant);
+		vector_size<N> pos;
+		for(size_t r = begin; r != end; ++r)
+		{
+			bool band = !hasInterior;
+			size_t n = r;
+			for(int d = N - 2; d >= 0; --d)
+			{
+				pos[d] = n % sizes[d];
+				n /= sizes[d];
+				band = band || pos[d] < lo[d] || pos[d] >= hi[d];
+			}
+
+			U *outRow = out;
+			for(int d = 0; d + 1 < N; ++d) outRow += pos[d] * outStrides[d];
+
+			auto cell = [&](size_t i)
+			{
+				pos[N - 1] = i;
+				neighbourhood.set_position(pos);
+				outRow[i * outStrides[N - 1]] = kernel(static_cast<const impl::BoundaryNeighbourhood<T, N, Radius>&>(neighbourhood));
+			};
+
+			if(band)
+			{
+				for(size_t i = 0; i != sizes[N - 1]; ++i) cell(i);
+			}
+			else
+			{
+				for(size_t i = 0; i != lo[N - 1]; ++i) cell(i);
+				for(size_t i = hi[N - 1]; i != sizes[N - 1]; ++i) cell(i);
+			}
+		}
+	});
+}
+
+// Applies the stencil steps times, swapping the arrays after every step (the swap doesn't copy),
+// so the result is in a. If buffer has other sizes it's made a copy of a first. With
+// vector_n_boundary::skip the border band of a is copied into buffer before the steps,
+// so the border cells keep their values in both arrays
+template<int Radius, class T, size_t N, class Allocator, class Kernel>
+void iterate_stencil(vector_n<T, N, Allocator> &a, vector_n<T, N, Allocator> &buffer, size_t steps, Kernel kernel,
+	vector_n_boundary boundary = vector_n_boundary::clamp, const T &constant = T(), unsigned numThreads = 0)
+{
+	if(buffer.size() != a.size()) buffer = a;
+	else if(boundary == vector_n_boundary::skip && Radius != 0 && steps != 0)
+	{
+		// Rows of the outer band whole and the ends of the other rows, like apply_stencil writes them
+		const vector_size<N> &sizes = a.size();
+		const vector_size<N> inStrides = a.strides(), outStrides = buffer.strides();
+		size_t rows = 1;
+		for(size_t d = 0; d + 1 < N; ++d) rows *= sizes[d];
+		if(sizes[N - 1] == 0) rows = 0;
+
+		const size_t length = sizes[N - 1], lo = std::min(length, size_t(Radius));
+		const size_t hi = length > 2 * size_t(Radius) ? length - Radius : lo;
+		for(size_t r = 0; r != rows; ++r)
+		{
+			const T *inRow = a.origin();
+			T *outRow = buffer.origin();
+			bool band = lo == hi;
+			size_t n = r;
+			for(size_t d = N - 1; d-- > 0;)
+			{
+				const size_t pos = n % sizes[d];
+				n /= sizes[d];
+				band = band || pos < size_t(Radius) || pos + Radius >= sizes[d];
+				inRow += pos * inStrides[d];
+				outRow += pos * outStrides[d];
+			}
+
+			auto copy = [&](size_t from, size_t to)
+			{
+				for(size_t i = from; i != to; ++i) outRow[i * outStrides[N - 1]] = inRow[i * inStrides[N - 1]];
+			};
+			if(band) copy(0, length);
+			else
+			{
+				copy(0, lo);
+				copy(hi, length);
+			}
+		}
+	}
+
+	for(size_t i = 0; i != steps; ++i)
+	{
+		apply_stencil<Radius>(a, buffer, kernel, boundary, constant, numThreads);
+		a.swap(buffer);
+	}
+}
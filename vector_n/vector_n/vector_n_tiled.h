@@ -0,0 +1,394 @@
+#pragma once
+#include "vector_n.h"
+
+// Default edge of the brick: the brick takes a few kilobytes, so it fits into L1 with its neighbours
+template<size_t numDims>
+constexpr size_t vector_n_brick_size = numDims == 1 ? 1024 : numDims == 2 ? 32 : numDims == 3 ? 8 : 4;
+
+namespace impl
+{
+	// Moves the bits of value apart, so there are step - 1 zero bits between the neighbouring ones
+	inline size_t spread_bits(size_t value, size_t step)
+	{
+		size_t res = 0;
+		for(size_t bit = 0; (value >> bit) != 0; ++bit) res |= ((value >> bit) & 1) << (bit * step);
+		return res;
+	}
+
+	// Calls f(ptr) for every element of the box [from, to), the last dimension is the innermost
+	template<class T, size_t N, class Function>
+	void tiled_for_each_box(T *data, const std::array<const size_t*, N> &tables,
+		const std::array<size_t, N> &from, const std::array<size_t, N> &to, Function &f)
+	{
+		for(size_t i = 0; i != N; ++i)
+		{
+			if(from[i] >= to[i]) return;
+		}
+
+		std::array<size_t, N> pos = from;
+		const size_t *inner = tables[N - 1];
+		while(true)
+		{
+			T *row = data;
+			for(size_t i = 0; i + 1 < N; ++i) row += tables[i][pos[i]];
+			for(size_t i = from[N - 1]; i != to[N - 1]; ++i) f(row[inner[i]]);
+
+			int i = int(N) - 2;
+			for(; i >= 0; --i)
+			{
+				if(++pos[i] != to[i]) break;
+				pos[i] = from[i];
+			}
+			if(i < 0) return;
+		}
+	}
+
+	// Slice of a tiled array. The offset of the element is the sum of the per-dimension tables,
+	// so any separable layout (like the bricks with the Morton order inside) works with it,
+	// and fixing a dimension just moves the pointer
+	template<class ElementType, int numDims>
+	class TiledSlice
+	{
+		template<class T, int N>
+		friend class TiledSlice;
+	public:
+		TiledSlice() : data(nullptr), tables{}, sizes{}
+		{
+		}
+
+		template<typename ... Indexes>
+		inline ElementType &operator()(Indexes ... indexes)
+		{
+			static_assert(impl::AllNumeric<Indexes...>::value, "Parameters type is invalid");
+			static_assert(sizeof...(indexes) == numDims, "Parameters count is invalid");
+			assert(impl::checkIndex(sizes.data(), indexes...) && "Indexes is invalid.");
+
+			return data[offset(indexes...)];
+		}
+
+		template<typename ... Indexes>
+		inline const ElementType &operator()(Indexes ... indexes) const
+		{
+			static_assert(impl::AllNumeric<Indexes...>::value, "Parameters type is invalid");
+			static_assert(sizeof...(indexes) == numDims, "Parameters count is invalid");
+			assert(impl::checkIndex(sizes.data(), indexes...) && "Indexes is invalid.");
+
+			return data[offset(indexes...)];
+		}
+
+		template<typename ... Indexes>
+		inline ElementType &at(Indexes ... indexes)
+		{
+			if(!impl::checkIndex(sizes.data(), indexes...)) throw std::out_of_range("One or more indexes are invalid");
+			return (*this)(indexes...);
+		}
+
+		template<typename ... Indexes>
+		inline const ElementType &at(Indexes ... indexes) const
+		{
+			if(!impl::checkIndex(sizes.data(), indexes...)) throw std::out_of_range("One or more indexes are invalid");
+			return (*this)(indexes...);
+		}
+
+		inline size_t size(const int numberDims) const
+		{
+			assert((numberDims - 1) < numDims && (numberDims - 1) >= 0 && "Parameters count is invalid");
+
+			return sizes[numberDims - 1];
+		}
+
+		inline const vector_size<numDims> &size() const
+		{
+			return sizes;
+		}
+
+		template<int...Indexes, class ...Args>
+		TiledSlice<ElementType, numDims - sizeof...(Indexes)> fix(Args ...c_index)
+		{
+			return fix_impl<ElementType, Indexes...>(c_index...);
+		}
+
+		template<int...Indexes, class ...Args>
+		TiledSlice<const ElementType, numDims - sizeof...(Indexes)> fix(Args ...c_index) const
+		{
+			return fix_impl<const ElementType, Indexes...>(c_index...);
+		}
+
+		// Calls f for every element in the order of the indexes, the last dimension is the innermost
+		template<class Function>
+		void for_each(Function f)
+		{
+			tiled_for_each_box(data, tables, vector_size<numDims>{}, sizes, f);
+		}
+
+		template<class Function>
+		void for_each(Function f) const
+		{
+			tiled_for_each_box(static_cast<const ElementType*>(data), tables, vector_size<numDims>{}, sizes, f);
+		}
+
+	protected:
+		void reset(ElementType *ptr, const std::array<const size_t*, numDims> &atables, const vector_size<numDims> &asizes)
+		{
+			data = ptr;
+			tables = atables;
+			sizes = asizes;
+		}
+
+		ElementType *data;
+		// Offsets of the positions along every dimension
+		std::array<const size_t*, numDims> tables;
+		vector_size<numDims> sizes;
+
+	private:
+		template<class T, int...Indexes, class ...Args>
+		TiledSlice<T, numDims - sizeof...(Indexes)> fix_impl(Args ...c_index) const
+		{
+			const int new_dim = numDims - sizeof...(Indexes);
+			static_assert(sizeof...(Indexes) == sizeof...(Args), "Indexes and template parameters count do not match");
+			static_assert(valid_index_set<numDims, Indexes...>, "Invalid index set");
+			static_assert(AllNumeric<Args...>::value, "Invalid arguments");
+
+			std::array<size_t, sizeof...(Indexes)> template_index{Indexes...};
+			std::array<size_t, sizeof...(Indexes)> args{size_t(c_index)...};
+
+			TiledSlice<T, new_dim> res;
+			res.data = data;
+			for(int i = 0, j = 0; i < numDims; ++i)
+			{
+				if(!has_v_fun<Indexes...>(i))
+				{
+					res.sizes[j] = sizes[i];
+					res.tables[j] = tables[i];
+					++j;
+				}
+			}
+			for(size_t i = 0; i != sizeof...(Indexes); ++i)
+			{
+				if(args[i] >= sizes[template_index[i]]) throw std::invalid_argument("One or more index too large");
+				res.data += tables[template_index[i]][args[i]];
+			}
+			return res;
+		}
+
+		template<typename ... Indexes>
+		inline size_t offset(Indexes ... indexes) const
+		{
+			size_t res = 0;
+			int d = 0;
+			((res += tables[d++][size_t(indexes)]), ...);
+			return res;
+		}
+	};
+}
+
+// Array stored in bricks of BrickSize^numDims elements (the bricks are in the row-major order,
+// the elements inside a brick are in the Morton order), so all neighbours of an element are
+// close in memory whatever the dimension is. The sizes are padded to a multiple of BrickSize
+template<class ElementType, size_t numDims, size_t BrickSize = vector_n_brick_size<numDims>>
+class vector_n_tiled : public impl::TiledSlice<ElementType, numDims>
+{
+	typedef impl::TiledSlice<ElementType, numDims> Base;
+	static_assert(BrickSize != 0 && (BrickSize & (BrickSize - 1)) == 0, "Brick size must be a power of two");
+public:
+	static constexpr size_t brick_size = BrickSize;
+
+	vector_n_tiled()
+	{
+	}
+
+	template<typename ... Sizes>
+	vector_n_tiled(Sizes ... sizes)
+	{
+		static_assert(sizeof...(sizes) == numDims, "Parameters count is invalid");
+		static_assert(impl::AllNumeric<Sizes...>::value, "Parameters type is invalid");
+
+		if(!impl::allPositive(sizes ...)) throw std::invalid_argument("All dimensions must be positive");
+
+		resize(vector_size<numDims>{size_t(sizes)...});
+	}
+
+	vector_n_tiled(const vector_n_tiled &other)
+		: Base(other), storage(other.storage), tableData(other.tableData), bricks(other.bricks)
+	{
+		repoint();
+	}
+
+	vector_n_tiled(vector_n_tiled &&other) noexcept
+		: Base(other), storage(std::move(other.storage)), tableData(std::move(other.tableData)), bricks(other.bricks)
+	{
+		repoint();
+		other.Base::reset(nullptr, {}, {});
+		other.bricks = {};
+	}
+
+	vector_n_tiled &operator=(const vector_n_tiled &other)
+	{
+		if(&other != this) vector_n_tiled(other).swap(*this);
+		return *this;
+	}
+
+	vector_n_tiled &operator=(vector_n_tiled &&other) noexcept
+	{
+		if(&other != this) vector_n_tiled(std::move(other)).swap(*this);
+		return *this;
+	}
+
+	void swap(vector_n_tiled &other) noexcept
+	{
+		storage.swap(other.storage);
+		tableData.swap(other.tableData);
+		std::swap(bricks, other.bricks);
+		std::swap(Base::sizes, other.Base::sizes);
+		repoint();
+		other.repoint();
+	}
+
+	// The contents are lost
+	void resize(const vector_size<numDims> &sizes)
+	{
+		size_t volume = 1, brickVolume = 1;
+		for(size_t i = 0; i != numDims; ++i)
+		{
+			bricks[i] = (sizes[i] + BrickSize - 1) / BrickSize;
+			volume *= bricks[i];
+			brickVolume *= BrickSize;
+		}
+
+		// Bricks are in the row-major order, inside a brick the bits of the coordinates are
+		// interleaved, the last dimension takes the lowest bit
+		size_t brickStride = brickVolume;
+		for(size_t d = numDims; d-- > 0;)
+		{
+			std::vector<size_t> &table = tableData[d];
+			table.resize(bricks[d] * BrickSize);
+			for(size_t i = 0; i != table.size(); ++i)
+			{
+				table[i] = i / BrickSize * brickStride + (impl::spread_bits(i % BrickSize, numDims) << (numDims - 1 - d));
+			}
+			brickStride *= bricks[d];
+		}
+
+		std::vector<ElementType>(volume * brickVolume).swap(storage);
+		Base::sizes = sizes;
+		repoint();
+	}
+
+	template<typename ... Sizes>
+	void resize(Sizes ... sizes)
+	{
+		resize(vector_size<numDims>{size_t(sizes)...});
+	}
+
+	// Number of the bricks along every dimension
+	const vector_size<numDims> &brick_count() const
+	{
+		return bricks;
+	}
+
+	// Calls f(from, to) for every brick with the box of indexes [from, to) it holds,
+	// the boxes at the upper borders are cut by the sizes
+	template<class Function>
+	void for_each_brick(Function f) const
+	{
+		const size_t count = brickTotal();
+		vector_size<numDims> pos{}, from, to;
+		for(size_t b = 0; b != count; ++b)
+		{
+			for(size_t i = 0; i != numDims; ++i)
+			{
+				from[i] = pos[i] * BrickSize;
+				to[i] = std::min(from[i] + BrickSize, Base::sizes[i]);
+			}
+			f(static_cast<const vector_size<numDims>&>(from), static_cast<const vector_size<numDims>&>(to));
+
+			for(size_t i = numDims; i-- > 0;)
+			{
+				if(++pos[i] != bricks[i]) break;
+				pos[i] = 0;
+			}
+		}
+	}
+
+	// Calls f for every element brick by brick in the order of memory
+	template<class Function>
+	void for_each(Function f)
+	{
+		for_each_impl(storage.data(), f);
+	}
+
+	template<class Function>
+	void for_each(Function f) const
+	{
+		for_each_impl(static_cast<const ElementType*>(storage.data()), f);
+	}
+
+	// Calls f for every element in the order of the indexes, the last dimension is the innermost
+	template<class Function>
+	void for_each_index_order(Function f)
+	{
+		Base::for_each(f);
+	}
+
+	template<class Function>
+	void for_each_index_order(Function f) const
+	{
+		Base::for_each(f);
+	}
+
+	// Storage including the padding of the border bricks
+	typename std::vector<ElementType>::iterator begin() { return storage.begin(); }
+	typename std::vector<ElementType>::iterator end() { return storage.end(); }
+	typename std::vector<ElementType>::const_iterator begin() const { return storage.begin(); }
+	typename std::vector<ElementType>::const_iterator end() const { return storage.end(); }
+
+private:
+	std::vector<ElementType> storage;
+	std::array<std::vector<size_t>, numDims> tableData;
+	vector_size<numDims> bricks{};
+
+	size_t brickTotal() const
+	{
+		size_t res = 1;
+		for(size_t count : bricks) res *= count;
+		return storage.empty() ? 0 : res;
+	}
+
+	void repoint()
+	{
+		std::array<const size_t*, numDims> tables;
+		for(size_t i = 0; i != numDims; ++i) tables[i] = tableData[i].data();
+		Base::reset(storage.data(), tables, Base::sizes);
+	}
+
+	template<class T, class Function>
+	void for_each_impl(T *ptr, Function &f) const
+	{
+		size_t brickVolume = 1;
+		for(size_t i = 0; i != numDims; ++i) brickVolume *= BrickSize;
+
+		std::array<const size_t*, numDims> tables;
+		for(size_t i = 0; i != numDims; ++i) tables[i] = tableData[i].data();
+
+		for_each_brick([&](const vector_size<numDims> &from, const vector_size<numDims> &to)
+		{
+			bool full = true;
+			for(size_t i = 0; i != numDims; ++i) full = full && to[i] - from[i] == BrickSize;
+
+			// The whole brick is one contiguous block
+			if(full)
+			{
+				T *brick = ptr;
+				for(size_t i = 0; i != numDims; ++i) brick += tables[i][from[i]];
+				for(size_t i = 0; i != brickVolume; ++i) f(brick[i]);
+			}
+			else impl::tiled_for_each_box(ptr, tables, from, to, f);
+		});
+	}
+};
+
+template<class ElementType, size_t numDims, size_t BrickSize>
+inline void swap(vector_n_tiled<ElementType, numDims, BrickSize> &a, vector_n_tiled<ElementType, numDims, BrickSize> &b) noexcept
+{
+	a.swap(b);
+}